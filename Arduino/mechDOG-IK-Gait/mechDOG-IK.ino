@@ -10,6 +10,8 @@
 
 #define MOVE_TIME 4000 //ms Time between movements for API example
 #define WIFI_TIME 25000
+#define STATS_TIME 0   //ms Period of the servo bus counters dump on the debug serial, 0 = never
+#define LINK_TIMEOUT 0 //ms Without any command from the WiFi link the robot stops and stands, 0 = never
 #define LSS_BAUD 38400
 #define MCU_BAUD 38400
 #define LSS_SERIAL  (Serial)
@@ -57,6 +59,7 @@ bool sample_sequence = false;
 Quadruped robot = Quadruped(MechDog);
 uint8_t state = 0;
 DTime state_time = DTime(MOVE_TIME);
+DTime stats_time = DTime(STATS_TIME);
 void sampleMoveSequence(){
   switch (state)
   {
@@ -128,6 +131,8 @@ void setup()
 {
   //Verify that the Baudrate used is the same as the one configured in the LSS servos.
   robot.initServoBus(LSS_SERIAL, LSS_BAUD);         //LSS bus w/ Hardware serial
+//robot.initServoBus(Serial1, Serial2, LSS_BAUD);   //Front & rear legs on separate buses (Mega, ESP32)
+//robot.initServoBus(LSS_SERIAL, LSS_BAUD, true);   //Move the servos to the fastest baud supported (see robot.getMaxFrameRate())
   delay(200);
   LSS(254).setColorLED(2);                          //Green (Check communication)
 
@@ -137,6 +142,8 @@ void setup()
   #elif QUADRUPED_CONTROL == C_WIFI
     //WiFi RC mode w/ Software serial
     robot.initMCUBus(WifiRC, BEE_SERIAL, MCU_BAUD);     
+    robot.setLinkTimeout(LINK_TIMEOUT);
+//  robot.enableBridge();                           //Forward any LSS command (queries too) from the WiFi link, between gait frames
     /*Uncomment the following instructions to view on the serial terminal 
     the IP assigned to the Xbee*/    
 //  delay(100);
@@ -155,5 +162,8 @@ void loop()
   if(state_time.getDT() && sample_sequence){
     sampleMoveSequence();
   }
+  if(STATS_TIME > 0 && stats_time.getDT()){
+    LSS::dumpStats(Serial);
+  }
   robot.loop();
 }
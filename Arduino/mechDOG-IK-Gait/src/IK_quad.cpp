@@ -42,10 +42,7 @@ void Joints::moveServos(int8_t id)
 	leg--;
 	joint--;
 	
-	int16_t angle = joint_angles[leg][joint] - joint_offsets[joint];
-	if (angle < joint_minmax[0][joint]) angle = joint_minmax[0][joint];
-	if (angle > joint_minmax[1][joint]) angle = joint_minmax[1][joint];
-	LSS(id).move(angle);
+	LSS(id).move(this->limitAngle(joint_angles[leg][joint], joint));
 }
 
 void Joints::moveServos(Leg leg)
@@ -54,28 +51,72 @@ void Joints::moveServos(Leg leg)
 	int16_t angle;
 	uint8_t leg_id = leg.leg_ID-1;
 	for (uint8_t joint = 0; joint < 3; joint++) {
-		angle = joint_angles[leg_id][joint] - joint_offsets[joint];
-		if (angle < joint_minmax[0][joint]) angle = joint_minmax[0][joint];
-		if (angle > joint_minmax[1][joint]) angle = joint_minmax[1][joint];
+		angle = this->limitAngle(joint_angles[leg_id][joint], joint);
 		id = (leg.leg_ID)*10 + joint + 1;
 		LSS(id).move(angle);
 	}
 }
+
+// Sends the published frame (see publishFrame)
 void Joints::moveServos(void)
 {	
 	uint8_t id;
 	int16_t angle;
-	for (uint8_t leg = 0; leg < 4; leg++) {
-		for (uint8_t joint = 0; joint < 3; joint++) {
-			angle = joint_angles[leg][joint] - joint_offsets[joint];
-			if (angle < joint_minmax[0][joint]) angle = joint_minmax[0][joint];
-			if (angle > joint_minmax[1][joint]) angle = joint_minmax[1][joint];
+	// Joint-major order alternates between legs so that, when the legs are split
+	// across several buses, every UART transmit buffer is filled in the same pass
+	for (uint8_t joint = 0; joint < 3; joint++) {
+		for (uint8_t leg = 0; leg < 4; leg++) {
+			angle = this->servoAngle(leg, joint);
 			id = (leg+1)*10 + joint+1;
 			LSS(id).move(angle);
 		}
 	}
 }
 
+// Send each joint once as a timed move (T = t_ms), the servos interpolate until the next keyframe.
+// Joints that did not change since the last keyframe are not sent again.
+void Joints::moveServosTimed(uint16_t t_ms)
+{	
+	uint8_t id;
+	int16_t angle;
+	for (uint8_t joint = 0; joint < 3; joint++) {
+		for (uint8_t leg = 0; leg < 4; leg++) {
+			angle = this->servoAngle(leg, joint);
+			if (this->sent_valid && this->sent_angles[leg][joint] == angle) continue;
+			id = (leg+1)*10 + joint+1;
+			LSS(id).moveT(angle, t_ms);
+			this->sent_angles[leg][joint] = angle;
+		}
+	}
+	this->sent_valid = true;
+}
+
+// Angle sent to a servo for the published frame
+int16_t Joints::servoAngle(uint8_t leg, uint8_t joint)
+{
+	return this->limitAngle(front_frame[leg][joint], joint);
+}
+
+// Joint offset removed, clamped to the joint range
+int16_t Joints::limitAngle(int16_t angle, uint8_t joint)
+{
+	angle -= joint_offsets[joint];
+	if (angle < joint_minmax[0][joint]) angle = joint_minmax[0][joint];
+	if (angle > joint_minmax[1][joint]) angle = joint_minmax[1][joint];
+	return angle;
+}
+
+// Make the frame computed in the back buffer the one transmitted by moveServos
+void Joints::publishFrame(void)
+{
+	memcpy(this->front_frame, this->joint_angles, sizeof(this->front_frame));
+}
+
+void Joints::resetSentFrame(void)
+{
+	this->sent_valid = false;
+}
+
 float Leg::foot_rad, Leg::L1, Leg::L2, Leg::L3;
 
 Leg::Leg(uint8_t leg_id, int16_t offset_x, int16_t offset_z, LSS_Robot_Model robot = MechDog)
@@ -162,7 +203,7 @@ void Leg::inverseKinematics(int16_t x, uint16_t y, int16_t z,int16_t joint_angle
 }
 
 
-Body::Body(LSS_Robot_Model robot = MechDog){
+Body::Body(LSS_Robot_Model robot){
 		this->model = robot;
 	    this->updateRobotModel(robot);
 		this->roll = 0;
@@ -201,7 +242,7 @@ int16_t Body::cgy_limits[2], Body::cgx_limits[2], Body::cgz_limits[2], Body::rol
 int16_t Body::cgx_dynamic_gait, Body::cgx_static_gait, Body::cgy_std, Body::cgz_std;
 uint8_t Body::foot_elevation, Body::jog_foot_elevation, Body::step_distance_dynamic, Body::step_distance_static;
 
-void Body::updateRobotModel(LSS_Robot_Model robot = MechDog){
+void Body::updateRobotModel(LSS_Robot_Model robot){
 	if (robot == MechDog){
 		// MECHDOG
 		this->w = W_MECHDOG;
@@ -265,7 +306,7 @@ void Body::updateRobotModel(LSS_Robot_Model robot = MechDog){
 bool Body::trajectory(uint8_t leg_ID, uint8_t i, float* foot_pos){
 	bool rest_pos_update = false;
 	uint8_t a = this->a;
-	uint8_t b = this->b;
+	uint8_t b = (uint16_t)this->b*this->step_scale/100;
 	
 	if (this->move_state == 0) b = 0;
 	if(this->jog_mode && this->director_angle == 0) 
@@ -607,6 +648,11 @@ void Body::robotPostureInit(void){
 
 }
 
+// Position in the gait cycle (0 to steps-1)
+int8_t Body::getCont(void){
+	return this->cont;
+}
+
 void Body::cgx_blocked(void){
 	switch (this->model)
 	{
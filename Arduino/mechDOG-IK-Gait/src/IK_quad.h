@@ -163,6 +163,7 @@ class Leg
 class Joints
 {
 	public:
+		// Back buffer: written by the IK of the current tick
 		int16_t joint_angles[4][3] =   {{0,0,0},
 										{0,0,0},
 										{0,0,0},
@@ -173,9 +174,21 @@ class Joints
 		void moveServos(int8_t id);
 		void moveServos(Leg leg);
 		void moveServos(void);
+		void moveServosTimed(uint16_t t_ms);
+		void resetSentFrame(void);
+		void publishFrame(void);
+		int16_t servoAngle(uint8_t leg, uint8_t joint);
 		
 
 	private:
+		// Front buffer: last published frame, the one moveServos(void) and moveServosTimed transmit
+		int16_t front_frame[4][3] =    {{0,0,0},
+										{0,0,0},
+										{0,0,0},
+										{0,0,0}};
+		int16_t limitAngle(int16_t angle, uint8_t joint);
+		int16_t sent_angles[4][3];
+		bool sent_valid = false;
 		static int16_t mechdog_joint_offsets[3] = {0,745,155};
 		static int16_t mechdog_joint_minmax[2][3] = {{-450,-600,0},	//min
 													 {450,600,1800}}; //max
@@ -197,6 +210,7 @@ class Body
 		Rotation_Dir new_rot_angle = StopRotation;
 		Foot_Trajectory trajectory_type = Circular;
 		Gait_Type new_beta = Static;
+		uint8_t step_scale = 100;	// % of the step length (gait derating)
 		int16_t balance_distance, w, l, X, Z;
 		static int16_t cgy_limits[2], cgx_limits[2], cgz_limits[2], roll_limits[2], pitch_limits[2], yaw_limits[2];
 		static int16_t cgx_dynamic_gait, cgx_static_gait, cgy_std, cgz_std;
@@ -211,6 +225,7 @@ class Body
 		void walk(void);
 		void specialMoves(void);
 		void robotPostureInit(void);
+		int8_t getCont(void);
 
 	private:
 		// Gait variables
@@ -12,394 +12,1280 @@
 #include "LSS.h"
 
 // -- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
-// Class attributes instantiation   ---- ---- ---- ---- ---- ---- ---- ---- ----
-//> Bus & status related
-bool LSS::hardwareSerial;
-Stream * LSS::bus;
-LSS_LastCommStatus LSS::lastCommStatus = LSS_CommStatus_Idle;
-uint32_t LSS::_msg_char_timeout = LSS_Timeout;
+// LSSBus   ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
 
-//> Command reading/writing
-volatile unsigned int LSS::readID;  // sscanf - assumes this
-char LSS::value[24];
+// Baud rates supported by the LSS, fastest first
+static const uint32_t LSS_Bauds[] = {500000, 460800, 250000, 230400, 115200, 57600, 38400, 19200, 9600};
 
-// -- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
-// Constructor  ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
-
-// Useful for declaring arrays; defaults to ID=0
-LSS::LSS()
+LSSBus::LSSBus()
 {
 	// Init state
-	this->servoID = LSS_ID_Default;
+	this->busType = LSS_BusNone;
+	this->stream = (Stream*) nullptr;
+	this->baud = 0;
+	this->lastCommStatus = LSS_CommStatus_Idle;
+	this->_start_response_timeout = LSS_Timeout;
+	this->_msg_char_timeout = LSS_Timeout;
+	this->writeTime = 0;
+	this->readDeadline = 0;
+	this->resetRTT();
+	this->resetStats();
+	for (uint8_t i = 0; i < LSS_MaxPendingQueries; i++)
+	{
+		this->pending[i].busy = false;
+		this->pending[i].done = false;
+	}
+	this->pendingOrder = 0;
+	this->rxState = LSS_ReplyWaitStart;
+	this->rxSlot = -1;
+	this->rxText[0] = '\0';
+	this->rxTextLength = 0;
 }
 
-// Recommended constructor
-LSS::LSS(uint8_t id)
+#ifdef LSS_SupportSoftwareSerial
+// Initialize bus using a software serial
+void LSSBus::initBus(SoftwareSerial &s, uint32_t baud)
 {
-	// Init state
-	this->servoID = id;
+	this->attach(s);
+	this->busType = LSS_BusSoftwareSerial;
+	this->baud = baud;
+	s.begin(baud);
+	s.listen();
 }
+#endif
 
-LSS::~LSS(void)
+// Initialize bus using a hardware serial
+void LSSBus::initBus(HardwareSerial &s, uint32_t baud)
 {
+	this->attach(s);
+	this->busType = LSS_BusHardwareSerial;
+	this->baud = baud;
+	s.begin(baud);
 }
 
-// -- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
-// Public functions (class)    ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
-void LSS::setReadTimeouts(uint32_t start_response_timeout, uint32_t msg_char_timeout)
+// Use an already opened stream as the bus (ex: emulated stream for host-side tests)
+void LSSBus::attach(Stream &s)
 {
-	_msg_char_timeout = msg_char_timeout;
-	bus->setTimeout(start_response_timeout);
+	this->stream = &s;
+	this->stream->setTimeout(LSS_Timeout);
+	this->busType = LSS_BusStream;
 }
 
+// Close the bus (stream), free pins and null reference
+void LSSBus::closeBus(void)
+{
+	switch (this->busType)
+	{
+		case (LSS_BusHardwareSerial):
+			static_cast<HardwareSerial*>(this->stream)->end();
+			break;
+#ifdef LSS_SupportSoftwareSerial
+		case (LSS_BusSoftwareSerial):
+			static_cast<SoftwareSerial*>(this->stream)->end();
+			break;
+#endif
+		default:
+			break;
+	}
+	this->stream = (Stream*) nullptr;
+	this->busType = LSS_BusNone;
+}
 
-int LSS::timedRead(void)
+bool LSSBus::isOpen(void)
+{
+	return (this->stream != (Stream*) nullptr);
+}
+
+// Change the baud rate of the MCU side of the bus (the servos are not reconfigured)
+void LSSBus::setBaud(uint32_t baud)
+{
+	switch (this->busType)
+	{
+		case (LSS_BusHardwareSerial):
+			static_cast<HardwareSerial*>(this->stream)->flush();
+			static_cast<HardwareSerial*>(this->stream)->end();
+			static_cast<HardwareSerial*>(this->stream)->begin(baud);
+			break;
+#ifdef LSS_SupportSoftwareSerial
+		case (LSS_BusSoftwareSerial):
+			static_cast<SoftwareSerial*>(this->stream)->end();
+			static_cast<SoftwareSerial*>(this->stream)->begin(baud);
+			break;
+#endif
+		default:
+			break;
+	}
+	this->baud = baud;
+	// Latencies measured at the old baud no longer apply
+	this->resetRTT();
+}
+
+uint32_t LSSBus::getBaud(void)
+{
+	return (this->baud);
+}
+
+Stream * LSSBus::getStream(void)
+{
+	return (this->stream);
+}
+
+LSS_LastCommStatus LSSBus::getLastCommStatus(void)
+{
+	return (this->lastCommStatus);
+}
+
+void LSSBus::setReadTimeouts(uint32_t start_response_timeout, uint32_t msg_char_timeout)
+{
+	this->_start_response_timeout = start_response_timeout;
+	this->_msg_char_timeout = msg_char_timeout;
+	if (this->stream != (Stream*) nullptr)
+		this->stream->setTimeout(start_response_timeout);
+}
+
+// Read a character; gives up at the deadline of the reply, or after msg_char_timeout
+int LSSBus::timedRead(void)
 {
 	int c;
 	unsigned long startMillis = millis();
 	do
 	{
-		c = LSS::bus->read();
+		c = this->stream->read();
 		if (c >= 0)
 			return (c);
-	} while (millis() - startMillis < _msg_char_timeout);
+	} while ((int32_t) (micros() - this->readDeadline) < 0 && millis() - startMillis < this->_msg_char_timeout);
 	return (-1);     // -1 indicates timeout
 }
 
-bool LSS::charToInt(char * inputstr, int32_t * intnum)
+// Build & write a LSS command to the bus using the provided ID (no value)
+// Max size for cmd = (LSS_MaxTotalCommandLength - 1)
+bool LSSBus::genericWrite(uint8_t id, const char * cmd)
 {
-	uint8_t neg = 0, i = 0, j = 0;  //, res = 0;
-	int32_t val = 0;
-	bool err;
+	// Exit condition
+	if (this->stream == (Stream*) nullptr)
+	{
+		this->lastCommStatus = LSS_CommStatus_WriteNoBus;
+		return (false);
+	}
+
+	// Build command
+	size_t bytes = this->stream->write('#');
+	// Servo ID
+	bytes += this->stream->print(id, DEC);
+	// Command
+	bytes += this->stream->write(cmd);
+	// Command end
+	bytes += this->stream->write('\r');
+	this->writeTime = micros();
+	this->countWrite(id, bytes);
+	// Success
+	this->lastCommStatus = LSS_CommStatus_WriteSuccess;
+	return (true);
+}
 
-	if (!inputstr) return true;
+// Build & write a LSS command to the bus using the provided ID and value
+// Max size for cmd = (LSS_MaxTotalCommandLength - 1)
+bool LSSBus::genericWrite(uint8_t id, const char * cmd, int16_t value)
+{
+	// Exit condition
+	if (this->stream == (Stream*) nullptr)
+	{
+		this->lastCommStatus = LSS_CommStatus_WriteNoBus;
+		return (false);
+	}
 
-	if (inputstr[0] == '0' && (inputstr[1] == 'x' || inputstr[1] == 'X'))
+	size_t bytes = this->stream->write('#');
+	// Servo ID
+	bytes += this->stream->print(id, DEC);
+	// Command
+	bytes += this->stream->write(cmd);
+	// Value
+	bytes += this->stream->print(value, DEC);
+	// Command end
+	bytes += this->stream->write('\r');
+	this->writeTime = micros();
+	this->countWrite(id, bytes);
+	// Success
+	this->lastCommStatus = LSS_CommStatus_WriteSuccess;
+	return (true);
+}
+
+// Build & write a LSS command to the bus using the provided ID and value
+// Max size for cmd = (LSS_MaxTotalCommandLength - 1)
+bool LSSBus::genericWrite(uint8_t id, const char * cmd, int16_t value, const char * parameter, int16_t parameter_value)
+{
+	// Exit condition
+	if (this->stream == (Stream*) nullptr)
+	{
+		this->lastCommStatus = LSS_CommStatus_WriteNoBus;
+		return (false);
+	}
+
+	size_t bytes = this->stream->write('#');
+	// Servo ID
+	bytes += this->stream->print(id, DEC);
+	// Command
+	bytes += this->stream->print(cmd);
+	// Value
+	bytes += this->stream->print(value, DEC);
+	bytes += this->stream->write(parameter);
+	// Parameter Value
+	bytes += this->stream->print(parameter_value, DEC);
+	// Command end
+	bytes += this->stream->write('\r');
+	this->writeTime = micros();
+	this->countWrite(id, bytes);
+	// Success
+	this->lastCommStatus = LSS_CommStatus_WriteSuccess;
+	return (true);
+}
+
+//==============================================================================
+// Reply values are decoded as they arrive (optional '-' then digits), without intermediate string
+static void LSS_valueStart(LSS_ValueDecoder & decoder)
+{
+	decoder.value = 0;
+	decoder.digits = 0;
+	decoder.negative = false;
+	decoder.valid = true;
+}
+
+static void LSS_valueFeed(LSS_ValueDecoder & decoder, char c)
+{
+	if (c == '-' && decoder.digits == 0 && !decoder.negative)
+		decoder.negative = true;
+	else if (IS_09(c) && decoder.digits < LSS_MaxValueDigits)
 	{
-		if (inputstr[2] == '\0') //"0x" only
+		decoder.value = decoder.value * 10 + CONVERTDEC(c);
+		decoder.digits++;
+	}
+	else
+		decoder.valid = false;
+}
+
+static bool LSS_valueEnd(LSS_ValueDecoder & decoder, int32_t & value)
+{
+	if (!decoder.valid || decoder.digits == 0)
+		return (false);
+	value = decoder.negative ? -decoder.value : decoder.value;
+	return (true);
+}
+
+// Blocking read of the reply to a query, decoded into the caller's result (safe to call from several places at once).
+// A value that is not a number (ex: model string, DIS) is copied into text if given, else it is a format error.
+bool LSSBus::genericRead(uint8_t id, const char * cmd, LSS_QueryResult & result, char * text, uint8_t text_size)
+{
+	result.id = id;
+	strncpy(result.cmd, cmd, LSS_MaxQueryLength);
+	result.cmd[LSS_MaxQueryLength] = '\0';
+	result.value = 0;
+	if (text != (char *) nullptr && text_size > 0)
+		text[0] = '\0';
+
+	// Exit condition
+	if (this->stream == (Stream*) nullptr)
+		return (this->readDone(result, LSS_CommStatus_ReadNoBus));
+
+	// The whole reply must be in before the adaptive timeout of this servo.
+	// A reply already waiting means we started reading late: do not use it as a latency sample.
+	bool measure = (this->stream->available() <= 0);
+	uint32_t start = this->writeTime;
+	if ((int32_t) (micros() - start) < 0 || micros() - start > this->getReplyTimeout(id))
+		start = micros();		// nothing written just before, count from now
+	this->readDeadline = start + this->getReplyTimeout(id);
+
+	// Read from bus until first character; exit if not found before timeout
+	int c;
+	while ((c = this->timedRead()) >= 0 && c != LSS_CommandReplyStart[0]);
+	if (c < 0)
+		return (this->readDone(result, LSS_CommStatus_ReadTimeout));
+
+	// Ok we have the * now now lets get the servo ID from the message.
+	unsigned int readID = 0;
+	bool valid_field = false;
+	while ((c = this->timedRead()) >= 0)
+	{
+		if ((c < '0') || (c > '9')) break;	// not a number character
+		readID = readID * 10 + c - '0';
+		valid_field = true;
+	}
+	if ((!valid_field) || (readID != id))
+		return (this->readDone(result, LSS_CommStatus_ReadWrongID));
+
+	// Now lets validate the right CMD
+	for (;;)
+	{
+		if (c != *cmd)
+			return (this->readDone(result, LSS_CommStatus_ReadWrongIdentifier));
+		cmd++;
+		if (*cmd == '\0')
+			break;
+		c = this->timedRead();
+	}
+
+	// Value, up to the CR
+	LSS_ValueDecoder decoder;
+	LSS_valueStart(decoder);
+	uint8_t length = 0;
+	for (;;)
+	{
+		c = this->timedRead();
+		if (c < 0 || c == LSS_CommandEnd[0])
+			break;
+		LSS_valueFeed(decoder, (char) c);
+		if (text != (char *) nullptr && length + 1 < text_size)
+			text[length++] = (char) c;
+	}
+	if (text != (char *) nullptr && text_size > 0)
+		text[length] = '\0';
+	if (c < 0)
+		return (this->readDone(result, LSS_CommStatus_ReadTimeout));	// did not get the ending CR
+	if (!LSS_valueEnd(decoder, result.value) && text == (char *) nullptr)
+		return (this->readDone(result, LSS_CommStatus_ReadWrongFormat));
+
+	uint32_t latency = 0;
+	if (measure)
+	{
+		latency = micros() - start;
+		this->addRTTSample(id, latency);
+	}
+	return (this->readDone(result, LSS_CommStatus_ReadSuccess, latency));
+}
+
+// latency: in us, 0 if it could not be measured
+bool LSSBus::readDone(LSS_QueryResult & result, LSS_LastCommStatus status, uint32_t latency)
+{
+	result.status = status;
+	result.timestamp = millis();
+	this->lastCommStatus = status;
+	if (status != LSS_CommStatus_ReadNoBus)
+		this->countRead(result.id, status, latency);
+	return (status == LSS_CommStatus_ReadSuccess);
+}
+
+//==============================================================================
+// Discard anything left in the receive buffer (ex: replies at a wrong baud)
+void LSSBus::flushInput(void)
+{
+	if (this->stream == (Stream*) nullptr)
+		return;
+	while (this->stream->read() >= 0);
+}
+
+// Write a baud configuration (CB); takes effect after the servo is reset
+bool LSSBus::configBaud(uint8_t id, uint32_t baud)
+{
+	// Exit condition
+	if (this->stream == (Stream*) nullptr)
+	{
+		this->lastCommStatus = LSS_CommStatus_WriteNoBus;
+		return (false);
+	}
+
+	size_t bytes = this->stream->write('#');
+	bytes += this->stream->print(id, DEC);
+	bytes += this->stream->write(LSS_ConfigBaud);
+	bytes += this->stream->print(baud, DEC);
+	bytes += this->stream->write('\r');
+	this->countWrite(id, bytes);
+	this->lastCommStatus = LSS_CommStatus_WriteSuccess;
+	return (true);
+}
+
+// Find the baud a servo answers at, trying first_baud then every LSS baud.
+// The bus is left at the baud found; returns 0 if the servo never answered.
+uint32_t LSSBus::probeBaud(uint8_t id, uint32_t first_baud)
+{
+	LSS_QueryResult result;
+	uint32_t candidate = first_baud;
+	for (int8_t i = -1; i < (int8_t) (sizeof(LSS_Bauds) / sizeof(LSS_Bauds[0])); i++)
+	{
+		if (i >= 0)
 		{
-			val = 0;
-			*intnum = 0;
-			err = false;
+			candidate = LSS_Bauds[i];
+			if (candidate == first_baud)
+				continue;
 		}
-		else
+		this->setBaud(candidate);
+		this->flushInput();
+		this->genericWrite(id, LSS_QueryStatus);
+		if (this->genericRead(id, LSS_QueryStatus, result))
+			return (candidate);
+	}
+	return (0);
+}
+
+// Returns how many of the servos answer a status query at the current baud
+uint8_t LSSBus::verify(const uint8_t * ids, uint8_t count)
+{
+	LSS_QueryResult result;
+	uint8_t answered = 0;
+	for (uint8_t i = 0; i < count; i++)
+	{
+		this->flushInput();
+		this->genericWrite(ids[i], LSS_QueryStatus);
+		if (this->genericRead(ids[i], LSS_QueryStatus, result))
+			answered++;
+	}
+	return (answered);
+}
+
+// Move the servos of this bus to the fastest baud <= max_baud:
+//	1. probe the baud they currently answer at (start_baud first), with the first servo that answers
+//	2. CB + RESET them to the new baud and re-sync the MCU side
+//	3. verify that every servo that answered before still answers, else go back to the baud that worked
+// Returns the baud the bus is left at (0 if no servo could be found).
+uint32_t LSSBus::upgradeBaud(const uint8_t * ids, uint8_t count, uint32_t start_baud, uint32_t max_baud)
+{
+	if (this->stream == (Stream*) nullptr || count == 0)
+		return (0);
+
+	// A missing servo must not stop the others from being upgraded
+	uint32_t found = 0;
+	for (uint8_t i = 0; i < count && found == 0; i++)
+		found = this->probeBaud(ids[i], start_baud);
+	if (found == 0)
+	{
+		this->setBaud(start_baud);
+		return (0);
+	}
+	uint8_t present = this->verify(ids, count);
+
+	uint32_t target = 0;
+	for (uint8_t i = 0; i < sizeof(LSS_Bauds) / sizeof(LSS_Bauds[0]); i++)
+	{
+		if (LSS_Bauds[i] <= max_baud)
 		{
-			for (i = 2; i < 11; i++)
-			{
-				if (inputstr[i] == '\0')
-				{
-					*intnum = val;
-					break;
-				}
-				if (ISVALIDHEX(inputstr[i]))
-				{
-					val = (val << 4) + CONVERTHEX(inputstr[i]);
-					err = true;
-				}
-				else
-				{
-					err = false;
-					break;
-				}
-			}
+			target = LSS_Bauds[i];
+			break;
 		}
-		/* over 8 digit hex --invalid */
-		if (i >= 11)
+	}
+	if (target <= found)
+		return (found);
+
+	// Switch
+	this->configBaud(LSS_BroadcastID, target);
+	this->genericWrite(LSS_BroadcastID, LSS_ActionReset);
+	delay(LSS_ResetTime);
+	this->setBaud(target);
+
+	// Verification round, every servo is asked
+	if (this->verify(ids, count) >= present)
+		return (target);
+
+	// Fallback: send the servos that did switch back to the known baud
+	this->configBaud(LSS_BroadcastID, found);
+	this->genericWrite(LSS_BroadcastID, LSS_ActionReset);
+	delay(LSS_ResetTime);
+	this->setBaud(found);
+	// Servos that never switched still hold the pending CB, overwrite it
+	this->configBaud(LSS_BroadcastID, found);
+	this->verify(ids, count);
+	return (found);
+}
+
+//==============================================================================
+// Non-blocking queries
+
+// Write a query and register it; returns a handle for getResult, or -1 if it could not be sent.
+// The reply is collected by poll(). Without callback, the caller must collect the result with getResult.
+int8_t LSSBus::request(uint8_t id, const char * cmd, LSS_QueryCallback callback, uint16_t deadline)
+{
+	return (this->request(id, cmd, LSS_QuerySession, callback, deadline));
+}
+
+// Same, for a query type other than the session value (ex: QAS1 for the config one).
+// The servo replies without the type (ex: *5QAS-2), so the reply is matched against cmd only.
+int8_t LSSBus::request(uint8_t id, const char * cmd, LSS_QueryType queryType, LSS_QueryCallback callback, uint16_t deadline)
+{
+	if (strlen(cmd) > LSS_MaxQueryLength)
+		return (-1);
+
+	int8_t slot = -1;
+	for (uint8_t i = 0; i < LSS_MaxPendingQueries; i++)
+	{
+		if (!this->pending[i].busy)
 		{
-			err = false;
+			slot = i;
+			break;
 		}
 	}
-	else /* max 10-digit decimal input */
+	if (slot < 0)
+		return (-1);
+	if (queryType == LSS_QuerySession ? !this->genericWrite(id, cmd) : !this->genericWrite(id, cmd, (int16_t) queryType))
+		return (-1);
+
+	LSS_PendingQuery &q = this->pending[slot];
+	q.result.id = id;
+	strcpy(q.result.cmd, cmd);
+	q.result.value = 0;
+	q.result.status = LSS_CommStatus_Idle;
+	q.result.timestamp = 0;
+	q.callback = callback;
+	q.deadline = millis() + deadline;
+	q.sent = this->writeTime;
+	q.order = this->pendingOrder++;
+	q.busy = true;
+	q.done = false;
+	return (slot);
+}
+
+// Consume the bytes already received and expire the queries past their deadline. Never waits.
+void LSSBus::poll(void)
+{
+	if (this->stream == (Stream*) nullptr)
+		return;
+
+	while (this->stream->available() > 0)
 	{
-		if (inputstr[i] == '-')
+		int c = this->stream->read();
+		if (c < 0)
+			break;
+		this->feedReply((char) c);
+	}
+
+	uint32_t now = millis();
+	for (uint8_t i = 0; i < LSS_MaxPendingQueries; i++)
+	{
+		if (this->pending[i].busy && !this->pending[i].done && (int32_t) (now - this->pending[i].deadline) >= 0)
 		{
-			// Indicate a negative int32_t
-			neg = 1;
+			if (this->rxSlot == (int8_t) i)
+				this->rxState = LSS_ReplySkip;		// late reply, drop the rest of it
+			this->completeQuery(i, LSS_CommStatus_ReadTimeout);
+		}
+	}
+}
 
-			// Skip the first character
-			j = 1;
+// Polled mode: returns true (and frees the handle) once the query has completed
+bool LSSBus::getResult(int8_t handle, LSS_QueryResult & result)
+{
+	if (handle < 0 || handle >= LSS_MaxPendingQueries)
+		return (false);
+	LSS_PendingQuery &q = this->pending[handle];
+	if (!q.busy || !q.done)
+		return (false);
+	result = q.result;
+	q.busy = false;
+	q.done = false;
+	return (true);
+}
+
+uint8_t LSSBus::pendingQueries(void)
+{
+	uint8_t count = 0;
+	for (uint8_t i = 0; i < LSS_MaxPendingQueries; i++)
+	{
+		if (this->pending[i].busy && !this->pending[i].done)
+			count++;
+	}
+	return (count);
+}
+
+// Value of the reply that completed the query, as the servo sent it (text values too, ex: QMS, QN).
+// Only valid in the callback of a query that got a reply (ReadSuccess or ReadWrongFormat).
+const char * LSSBus::getReplyText(void)
+{
+	return (this->rxText);
+}
+
+void LSSBus::completeQuery(int8_t slot, LSS_LastCommStatus status)
+{
+	LSS_PendingQuery &q = this->pending[slot];
+	uint32_t latency = 0;
+	if (status == LSS_CommStatus_ReadSuccess)
+	{
+		latency = micros() - q.sent;
+		this->addRTTSample(q.result.id, latency);
+	}
+	this->countRead(q.result.id, status, latency);
+	q.result.status = status;
+	q.result.timestamp = millis();
+	q.done = true;
+	this->lastCommStatus = status;
+	if (q.callback != (LSS_QueryCallback) nullptr)
+	{
+		// Free the slot first so the callback can issue the next query
+		q.busy = false;
+		q.done = false;
+		q.callback(q.result);
+	}
+}
+
+// Reply timeout for a servo, in us: smoothed latency + 4 deviations (RFC 6298 style).
+// Servos never heard from get the fixed start response timeout.
+uint32_t LSSBus::getReplyTimeout(uint8_t id)
+{
+	uint32_t max_timeout = this->_start_response_timeout * 1000;
+	const LSS_RTT * entry = this->getRTT(id);
+	if (entry == (const LSS_RTT *) nullptr || entry->samples == 0)
+		return (max_timeout);
+	uint32_t timeout = entry->srtt + 4 * entry->rttvar;
+	if (timeout < LSS_MinReplyTimeout)
+		timeout = LSS_MinReplyTimeout;
+	if (timeout > max_timeout)
+		timeout = max_timeout;
+	return (timeout);
+}
+
+const LSS_RTT * LSSBus::getRTT(uint8_t id)
+{
+#ifdef LSS_SupportAdaptiveTimeouts
+	for (uint8_t i = 0; i < this->rttCount; i++)
+	{
+		if (this->rtt[i].id == id)
+			return (&this->rtt[i]);
+	}
+#else
+	(void) id;
+#endif
+	return ((const LSS_RTT *) nullptr);
+}
+
+uint8_t LSSBus::getRTTCount(void)
+{
+#ifdef LSS_SupportAdaptiveTimeouts
+	return (this->rttCount);
+#else
+	return (0);
+#endif
+}
+
+const LSS_RTT & LSSBus::getRTTEntry(uint8_t index)
+{
+#ifdef LSS_SupportAdaptiveTimeouts
+	return (this->rtt[index < this->rttCount ? index : 0]);
+#else
+	(void) index;
+	static const LSS_RTT none = {LSS_BroadcastID, 0, 0, 0};
+	return (none);
+#endif
+}
+
+void LSSBus::resetRTT(void)
+{
+#ifdef LSS_SupportAdaptiveTimeouts
+	this->rttCount = 0;
+	this->rttNext = 0;
+#endif
+}
+
+// srtt += (rtt - srtt)/8, rttvar += (|rtt - srtt| - rttvar)/4
+void LSSBus::addRTTSample(uint8_t id, uint32_t rtt)
+{
+#ifdef LSS_SupportAdaptiveTimeouts
+	LSS_RTT * entry = (LSS_RTT *) this->getRTT(id);
+	if (entry == (LSS_RTT *) nullptr)
+	{
+		// New servo, reuse the entries in turn once the table is full
+		if (this->rttCount < LSS_MaxRTTEntries)
+			entry = &this->rtt[this->rttCount++];
+		else
+		{
+			entry = &this->rtt[this->rttNext];
+			this->rttNext = (this->rttNext + 1) % LSS_MaxRTTEntries;
 		}
-		for (i = j; i < 11; i++)
+		entry->id = id;
+		entry->samples = 0;
+	}
+	if (entry->samples == 0)
+	{
+		entry->srtt = rtt;
+		entry->rttvar = rtt / 2;
+	}
+	else
+	{
+		int32_t error = (int32_t) rtt - (int32_t) entry->srtt;
+		entry->srtt = (int32_t) entry->srtt + error / 8;
+		if (error < 0)
+			error = -error;
+		entry->rttvar = (int32_t) entry->rttvar + (error - (int32_t) entry->rttvar) / 4;
+	}
+	if (entry->samples < 0xFFFF)
+		entry->samples++;
+#else
+	(void) id;
+	(void) rtt;
+#endif
+}
+
+//==============================================================================
+// Health counters
+
+// Counters of a servo (LSS_BroadcastID: of the whole bus); false if this bus never talked to it
+bool LSSBus::getStats(uint8_t id, LSS_BusStats & stats)
+{
+#ifdef LSS_SupportBusStats
+	if (id == LSS_BroadcastID)
+	{
+		stats = this->busStats;
+		return (true);
+	}
+	for (uint8_t i = 0; i < this->statsCount; i++)
+	{
+		if (this->stats[i].id == id)
 		{
-			if (inputstr[i] == '\0')
-			{
-				if (neg)
-				{
-					if (i == j)
-					{
-						err = false;
-					}
-					else
-					{
-						val = -val;
-					}
-				}
-				else
-				{
-					if (i == 0)
-					{
-						err = false;
-					}
-				}
-
-				*intnum = val;
+			stats = this->stats[i];
+			return (true);
+		}
+	}
+#else
+	(void) id;
+	(void) stats;
+#endif
+	return (false);
+}
+
+uint8_t LSSBus::getStatsCount(void)
+{
+#ifdef LSS_SupportBusStats
+	return (this->statsCount);
+#else
+	return (0);
+#endif
+}
+
+const LSS_BusStats & LSSBus::getStatsEntry(uint8_t index)
+{
+#ifdef LSS_SupportBusStats
+	return (this->stats[index < this->statsCount ? index : 0]);
+#else
+	(void) index;
+	static const LSS_BusStats none = {LSS_BroadcastID, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+	return (none);
+#endif
+}
+
+void LSSBus::resetStats(void)
+{
+#ifdef LSS_SupportBusStats
+	memset(&this->busStats, 0, sizeof(this->busStats));
+	this->busStats.id = LSS_BroadcastID;
+	this->busStats.latencyMin = 0xFFFF;
+	this->statsCount = 0;
+	this->statsNext = 0;
+#endif
+}
+
+#ifdef LSS_SupportBusStats
+// Entry of a servo, a new servo reuses the entries in turn once the table is full
+static LSS_BusStats * LSS_statsEntry(LSS_BusStats * table, uint8_t & count, uint8_t & next, uint8_t id)
+{
+	for (uint8_t i = 0; i < count; i++)
+	{
+		if (table[i].id == id)
+			return (&table[i]);
+	}
+	LSS_BusStats * entry;
+	if (count < LSS_MaxStatsEntries)
+		entry = &table[count++];
+	else
+	{
+		entry = &table[next];
+		next = (next + 1) % LSS_MaxStatsEntries;
+	}
+	memset(entry, 0, sizeof(LSS_BusStats));
+	entry->id = id;
+	entry->latencyMin = 0xFFFF;
+	return (entry);
+}
+
+static void LSS_statsError(LSS_BusStats & stats, LSS_LastCommStatus status)
+{
+	switch (status)
+	{
+		case (LSS_CommStatus_ReadTimeout):
+			stats.timeouts++;
+			break;
+		case (LSS_CommStatus_ReadWrongID):
+			stats.wrongID++;
+			break;
+		case (LSS_CommStatus_ReadWrongIdentifier):
+			stats.wrongIdentifier++;
+			break;
+		case (LSS_CommStatus_ReadWrongFormat):
+			stats.wrongFormat++;
+			break;
+		default:
+			break;
+	}
+}
+
+static void LSS_statsLatency(LSS_BusStats & stats, uint32_t latency)
+{
+	uint16_t sample = latency > 0xFFFF ? 0xFFFF : latency;
+	if (sample < stats.latencyMin)
+		stats.latencyMin = sample;
+	if (sample > stats.latencyMax)
+		stats.latencyMax = sample;
+	stats.latencySum += sample;
+	stats.latencySamples++;
+	if (stats.latencySamples == 0xFFFF)
+	{
+		// Keep the average meaningful instead of wrapping
+		stats.latencySum /= 2;
+		stats.latencySamples /= 2;
+	}
+}
+#endif
 
+// Broadcast commands are only counted for the whole bus
+void LSSBus::countWrite(uint8_t id, size_t bytes)
+{
+#ifdef LSS_SupportBusStats
+	this->busStats.writes++;
+	this->busStats.bytes += bytes;
+	if (id > LSS_ID_Max)
+		return;
+	LSS_BusStats * entry = LSS_statsEntry(this->stats, this->statsCount, this->statsNext, id);
+	entry->writes++;
+	entry->bytes += bytes;
+#else
+	(void) id;
+	(void) bytes;
+#endif
+}
+
+// A reply was expected: status is the outcome, latency in us (0 if it could not be measured)
+void LSSBus::countRead(uint8_t id, LSS_LastCommStatus status, uint32_t latency)
+{
+#ifdef LSS_SupportBusStats
+	LSS_BusStats * entry = (id <= LSS_ID_Max) ? LSS_statsEntry(this->stats, this->statsCount, this->statsNext, id) : (LSS_BusStats *) nullptr;
+	this->busStats.reads++;
+	if (entry != (LSS_BusStats *) nullptr)
+		entry->reads++;
+	if (status != LSS_CommStatus_ReadSuccess)
+		this->countError(id, status);
+	else if (latency > 0)
+	{
+		LSS_statsLatency(this->busStats, latency);
+		if (entry != (LSS_BusStats *) nullptr)
+			LSS_statsLatency(*entry, latency);
+	}
+#else
+	(void) id;
+	(void) status;
+	(void) latency;
+#endif
+}
+
+// Error seen on the bus, with or without a read of its own (ex: stray reply of the non-blocking queries)
+void LSSBus::countError(uint8_t id, LSS_LastCommStatus status)
+{
+#ifdef LSS_SupportBusStats
+	LSS_statsError(this->busStats, status);
+	if (id <= LSS_ID_Max)
+		LSS_statsError(*LSS_statsEntry(this->stats, this->statsCount, this->statsNext, id), status);
+#else
+	(void) id;
+	(void) status;
+#endif
+}
+
+// Incremental reply parser: *<id><cmd><value>\r, one byte at a time
+void LSSBus::feedReply(char c)
+{
+	if (c == LSS_CommandReplyStart[0])
+	{
+		// A new reply always restarts the parser (resync after garbage)
+		this->rxState = LSS_ReplyID;
+		this->rxID = 0;
+		this->rxIndex = 0;
+		this->rxSlot = -1;
+		return;
+	}
+
+	switch (this->rxState)
+	{
+		case (LSS_ReplyID):
+		{
+			if (IS_09(c))
+			{
+				this->rxID = this->rxID * 10 + CONVERTDEC(c);
+				this->rxIndex++;
+				break;
+			}
+			if (this->rxIndex == 0)
+			{
+				this->rxState = LSS_ReplySkip;
 				break;
 			}
-			else if (ISVALIDDEC(inputstr[i]))
+			// Oldest pending query for this ID
+			for (uint8_t i = 0; i < LSS_MaxPendingQueries; i++)
 			{
-				val = val * 10 + CONVERTDEC(inputstr[i]);
-				err = true;
+				LSS_PendingQuery &q = this->pending[i];
+				if (!q.busy || q.done || q.result.id != this->rxID)
+					continue;
+				if (this->rxSlot < 0 || (int8_t) (q.order - this->pending[this->rxSlot].order) < 0)
+					this->rxSlot = i;
 			}
-			else
+			if (this->rxSlot < 0)
 			{
-				err = false;
+				// Not an answer to a pending query
+				this->rxState = LSS_ReplySkip;
 				break;
 			}
+			this->rxState = LSS_ReplyCommand;
+			this->rxIndex = 0;
+			this->feedReply(c);		// c is the first command character
+			break;
+		}
+		case (LSS_ReplyCommand):
+		{
+			const char * cmd = this->pending[this->rxSlot].result.cmd;
+			if (c != cmd[this->rxIndex])
+			{
+				this->lastCommStatus = LSS_CommStatus_ReadWrongIdentifier;
+				this->countError(this->rxID, LSS_CommStatus_ReadWrongIdentifier);
+				this->rxState = LSS_ReplySkip;
+				break;
+			}
+			this->rxIndex++;
+			if (cmd[this->rxIndex] == '\0')
+			{
+				this->rxState = LSS_ReplyValue;
+				LSS_valueStart(this->rxDecoder);
+				this->rxTextLength = 0;
+			}
+			break;
 		}
-		/* Over 10 digit decimal --invalid */
-		if (i >= 11)
+		case (LSS_ReplyValue):
 		{
-			err = false;
+			if (c == LSS_CommandEnd[0])
+			{
+				LSS_QueryResult &r = this->pending[this->rxSlot].result;
+				this->rxText[this->rxTextLength] = '\0';
+				bool valid = LSS_valueEnd(this->rxDecoder, r.value);
+				this->completeQuery(this->rxSlot, valid ? LSS_CommStatus_ReadSuccess : LSS_CommStatus_ReadWrongFormat);
+				this->rxState = LSS_ReplyWaitStart;
+				break;
+			}
+			LSS_valueFeed(this->rxDecoder, c);
+			if (this->rxTextLength < LSS_MaxReplyText)
+				this->rxText[this->rxTextLength++] = c;
+			break;
 		}
+		case (LSS_ReplySkip):
+		{
+			if (c == LSS_CommandEnd[0])
+				this->rxState = LSS_ReplyWaitStart;
+			break;
+		}
+		default:
+			break;
 	}
+}
+
+// -- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+// Class attributes instantiation   ---- ---- ---- ---- ---- ---- ---- ---- ----
+//> Bus & status related
+LSSBus LSS::buses[LSS_MaxBuses];		// buses[0] is the default bus
+uint8_t LSS::idGroupBus[LSS_IDGroups];	// all IDs default to bus 0
+#ifdef LSS_SupportShadowCache
+LSS_ShadowEntry LSS::shadow[LSS_ShadowEntries];
+uint16_t LSS::shadowTTL[LSS_ShadowFields] = {
+	LSS_ShadowDefaultTTL, LSS_ShadowDefaultTTL, LSS_ShadowDefaultTTL, LSS_ShadowDefaultTTL,
+	LSS_ShadowDefaultTTL, LSS_ShadowDefaultTTL, LSS_ShadowDefaultTTL, LSS_ShadowDefaultTTL,
+	LSS_ShadowDefaultTTL, LSS_ShadowDefaultTTL, LSS_ShadowDefaultTTL
+};
+#endif
+
+// -- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+// Constructor  ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+// Useful for declaring arrays; defaults to ID=0
+LSS::LSS()
+{
+	// Init state
+	this->servoID = LSS_ID_Default;
+	this->bus = (LSSBus*) nullptr;
+}
+
+// Recommended constructor
+LSS::LSS(uint8_t id)
+{
+	// Init state
+	this->servoID = id;
+	this->bus = (LSSBus*) nullptr;
+}
+
+// Servo handle bound to a specific bus instead of the ID routing table
+LSS::LSS(uint8_t id, LSSBus & bus)
+{
+	// Init state
+	this->servoID = id;
+	this->bus = &bus;
+}
+
+LSS::~LSS(void)
+{
+}
+
+// -- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+// Public functions (class)    ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+void LSS::setReadTimeouts(uint32_t start_response_timeout, uint32_t msg_char_timeout)
+{
+	for (uint8_t b = 0; b < LSS_MaxBuses; b++)
+		buses[b].setReadTimeouts(start_response_timeout, msg_char_timeout);
+}
+
+int LSS::timedRead(void)
+{
+	return (buses[0].timedRead());
+}
+
+#ifdef LSS_SupportSoftwareSerial
+// Initialize the default bus using a software serial
+void LSS::initBus(SoftwareSerial &s, uint32_t baud)
+{
+	buses[0].initBus(s, baud);
+}
+#endif
+
+// Initialize the default bus using a hardware serial
+void LSS::initBus(HardwareSerial &s, uint32_t baud)
+{
+	buses[0].initBus(s, baud);
+}
+
+// Initialize an additional bus using a hardware serial (ex: Serial1 on a Mega/ESP32)
+void LSS::initBus(HardwareSerial &s, uint32_t baud, uint8_t busNum)
+{
+	if (busNum >= LSS_MaxBuses)
+		return;
+	buses[busNum].initBus(s, baud);
+}
+
+// Use an already opened stream as a bus (ex: emulated stream for host-side tests)
+void LSS::attachBus(Stream &s, uint8_t busNum)
+{
+	if (busNum >= LSS_MaxBuses)
+		return;
+	buses[busNum].attach(s);
+}
+
+// Route IDs [group*10, group*10+9] to a bus (ex: group 2 = servos 21, 22, 23)
+void LSS::mapIDGroup(uint8_t group, uint8_t busNum)
+{
+	if (group >= LSS_IDGroups || busNum >= LSS_MaxBuses)
+		return;
+	idGroupBus[group] = busNum;
+}
+
+// Returns one of the library buses (0 = default bus)
+LSSBus & LSS::getBus(uint8_t busNum)
+{
+	if (busNum >= LSS_MaxBuses)
+		busNum = 0;
+	return (buses[busNum]);
+}
 
-	// Success
-	return (err);
+// Returns the bus a servo ID is routed to
+LSSBus & LSS::getBusForID(uint8_t id)
+{
+	if (id > LSS_ID_Max)
+		return (buses[0]);
+	return (buses[idGroupBus[id / 10]]);
 }
 
-#ifdef LSS_SupportSoftwareSerial
-// Initialize bus using a software serial
-void LSS::initBus(SoftwareSerial &s, uint32_t baud)
+// Close all the library buses
+void LSS::closeBus(void)
 {
-	bus = &s;
-	bus->setTimeout(LSS_Timeout);
-	hardwareSerial = false;
-	s.begin(baud);
-	s.listen();
+	for (uint8_t b = 0; b < LSS_MaxBuses; b++)
+		buses[b].closeBus();
 }
-#endif
 
-// Initialize bus using a hardware serial
-void LSS::initBus(HardwareSerial &s, uint32_t baud)
+// Collect the replies of the non-blocking queries on every bus (call as often as possible)
+void LSS::pollBuses(void)
 {
-	bus = &s;
-	bus->setTimeout(LSS_Timeout);
-	hardwareSerial = true;
-	s.begin(baud);
+	for (uint8_t b = 0; b < LSS_MaxBuses; b++)
+		buses[b].poll();
 }
 
-// Close the bus (stream), free pins and null reference
-void LSS::closeBus(void)
+// Time a cached value stays fresh (ms); 0 = always ask the servo
+void LSS::setShadowTTL(LSS_ShadowField field, uint16_t ttl)
 {
-#ifdef LSS_SupportSoftwareSerial
-	if (hardwareSerial)
-	{
-		static_cast<HardwareSerial*>(bus)->end();
-	}
-	else
-	{
-		static_cast<SoftwareSerial*>(bus)->end();
-	}
-	bus = (Stream*) nullptr;
+#ifdef LSS_SupportShadowCache
+	if (field < LSS_ShadowFields)
+		shadowTTL[field] = ttl;
 #else
-	static_cast<HardwareSerial*>(bus)->end();
+	(void) field;
+	(void) ttl;
 #endif
 }
 
-// Build & write a LSS command to the bus using the provided ID (no value)
-// Max size for cmd = (LSS_MaxTotalCommandLength - 1)
-bool LSS::genericWrite(uint8_t id, const char * cmd)
+// Forget the cached values of a servo (broadcast ID: of every servo)
+void LSS::invalidateShadow(uint8_t id)
 {
-	// Exit condition
-	if (bus == (Stream*) nullptr)
+#ifdef LSS_SupportShadowCache
+	for (uint8_t i = 0; i < LSS_ShadowEntries; i++)
 	{
-		lastCommStatus = LSS_CommStatus_WriteNoBus;
-		return (false);
+		if (id == LSS_BroadcastID || shadow[i].id == id)
+			shadow[i].valid = false;
 	}
-
-	// Build command
-	bus->write('#');
-	// Servo ID
-	bus->print(id, DEC);
-	// Command
-	bus->write(cmd);
-	// Command end
-	bus->write('\r');
-	// Success
-	lastCommStatus = LSS_CommStatus_WriteSuccess;
-	return (true);
+#else
+	(void) id;
+#endif
 }
 
-// Build & write a LSS command to the bus using the provided ID and value
-// Max size for cmd = (LSS_MaxTotalCommandLength - 1)
-bool LSS::genericWrite(uint8_t id, const char * cmd, int16_t value)
+// Health counters of a servo, from the bus of its ID; LSS_BroadcastID sums every bus
+bool LSS::getStats(uint8_t id, LSS_BusStats & stats)
 {
-	// Exit condition
-	if (bus == (Stream*) nullptr)
+	if (id != LSS_BroadcastID)
+		return (getBusForID(id).getStats(id, stats));
+
+	LSS_BusStats bus;
+	bool found = false;
+	for (uint8_t b = 0; b < LSS_MaxBuses; b++)
 	{
-		lastCommStatus = LSS_CommStatus_WriteNoBus;
-		return (false);
+		if (!buses[b].getStats(LSS_BroadcastID, bus))
+			continue;
+		if (!found)
+		{
+			stats = bus;
+			found = true;
+			continue;
+		}
+		stats.writes += bus.writes;
+		stats.bytes += bus.bytes;
+		stats.reads += bus.reads;
+		stats.timeouts += bus.timeouts;
+		stats.wrongID += bus.wrongID;
+		stats.wrongIdentifier += bus.wrongIdentifier;
+		stats.wrongFormat += bus.wrongFormat;
+		if (bus.latencyMin < stats.latencyMin)
+			stats.latencyMin = bus.latencyMin;
+		if (bus.latencyMax > stats.latencyMax)
+			stats.latencyMax = bus.latencyMax;
+		stats.latencySum += bus.latencySum;
+		stats.latencySamples += bus.latencySamples;
+	}
+	return (found);
+}
+
+// One line of counters: id,writes,bytes,reads,timeouts,wrongID,wrongIdentifier,wrongFormat,latencyMin,latencyAvg,latencyMax
+// (latencies in us, 0 when no reply was timed). A servo without counters prints zeros.
+void LSS::printStats(Print & out, uint8_t id)
+{
+	LSS_BusStats stats;
+	if (!getStats(id, stats))
+		memset(&stats, 0, sizeof(stats));
+	bool timed = (stats.latencySamples > 0);
+	out.print(id, DEC);
+	out.write(',');
+	out.print(stats.writes, DEC);
+	out.write(',');
+	out.print(stats.bytes, DEC);
+	out.write(',');
+	out.print(stats.reads, DEC);
+	out.write(',');
+	out.print(stats.timeouts, DEC);
+	out.write(',');
+	out.print(stats.wrongID, DEC);
+	out.write(',');
+	out.print(stats.wrongIdentifier, DEC);
+	out.write(',');
+	out.print(stats.wrongFormat, DEC);
+	out.write(',');
+	out.print(timed ? stats.latencyMin : 0, DEC);
+	out.write(',');
+	out.print(timed ? stats.latencySum / stats.latencySamples : 0, DEC);
+	out.write(',');
+	out.print(stats.latencyMax, DEC);
+}
+
+// Every servo then the bus totals, one line each (ex: on the debug serial)
+void LSS::dumpStats(Print & out)
+{
+	out.println(F("ID,writes,bytes,reads,timeouts,wrongID,wrongCmd,format,minUs,avgUs,maxUs"));
+	for (uint8_t b = 0; b < LSS_MaxBuses; b++)
+	{
+		for (uint8_t i = 0; i < buses[b].getStatsCount(); i++)
+		{
+			printStats(out, buses[b].getStatsEntry(i).id);
+			out.println();
+		}
 	}
-
-	bus->write('#');
-	// Servo ID
-	bus->print(id, DEC);
-	// Command
-	bus->write(cmd);
-	// Value
-	bus->print(value, DEC);
-	// Command end
-	bus->write('\r');
-	// Success
-	lastCommStatus = LSS_CommStatus_WriteSuccess;
-	return (true);
+	printStats(out, LSS_BroadcastID);
+	out.println();
 }
 
-// Build & write a LSS command to the bus using the provided ID and value
-// Max size for cmd = (LSS_MaxTotalCommandLength - 1)
-bool LSS::genericWrite(uint8_t id, const char * cmd, int16_t value, const char * parameter, int16_t parameter_value)
+void LSS::resetStats(void)
 {
-	// Exit condition
-	if (bus == (Stream*) nullptr)
-	{
-		lastCommStatus = LSS_CommStatus_WriteNoBus;
-		return (false);
-	}
-
-	bus->write('#');
-	// Servo ID
-	bus->print(id, DEC);
-	// Command
-	bus->print(cmd);
-	// Value
-	bus->print(value, DEC);
-	bus->write(parameter);
-	// Parameter Value
-	bus->print(parameter_value, DEC);
-	// Command end
-	bus->write('\r');
-	// Success
-	lastCommStatus = LSS_CommStatus_WriteSuccess;
-	return (true);
+	for (uint8_t b = 0; b < LSS_MaxBuses; b++)
+		buses[b].resetStats();
 }
-//==============================================================================
-char * LSS::genericRead_Blocking_str(uint8_t id, const char * cmd)
-{
-	// Exit condition
-	if (bus == (Stream*) nullptr)
-	{
-		lastCommStatus = LSS_CommStatus_ReadNoBus;
-		return ((char *) nullptr);
-	}
 
-	// 
-
-	// Read from bus until first character; exit if not found before timeout
-	if (!(bus->find(LSS_CommandReplyStart)))
-	{
-		lastCommStatus = LSS_CommStatus_ReadTimeout;
-		return ((char *) nullptr);
-	}
+// Default-bus shims: commands are routed to the bus of the ID.
+// Broadcast and mode 255 commands are written to every initialized bus.
+bool LSS::genericWrite(uint8_t id, const char * cmd)
+{
+	if (id != LSS_BroadcastID && id != LSS_Mode255ID)
+		return (getBusForID(id).genericWrite(id, cmd));
 
-	// Ok we have the * now now lets get the servo ID from the message.
-	readID = 0;
-	int c;
-	bool valid_field = 0;
-	while ((c = LSS::timedRead()) >= 0)
+	bool sent = false;
+	for (uint8_t b = 0; b < LSS_MaxBuses; b++)
 	{
-		if ((c < '0') || (c > '9')) break;	// not a number character
-		readID = readID * 10 + c - '0';
-		valid_field = true;
+		if (buses[b].isOpen())
+			sent |= buses[b].genericWrite(id, cmd);
 	}
+	if (!sent)
+		buses[0].genericWrite(id, cmd);	// records WriteNoBus
+	return (sent);
+}
 
-	if ((!valid_field) || (readID != id))
-	{
-		lastCommStatus = LSS_CommStatus_ReadWrongID;
-		// BUGBUG Should we clear out until CR?
-		return ((char *) nullptr);
-	} 
+bool LSS::genericWrite(uint8_t id, const char * cmd, int16_t value)
+{
+	if (id != LSS_BroadcastID && id != LSS_Mode255ID)
+		return (getBusForID(id).genericWrite(id, cmd, value));
 
-	// Now lets validate the right CMD
-	for (;;)
+	bool sent = false;
+	for (uint8_t b = 0; b < LSS_MaxBuses; b++)
 	{
-		if (c != *cmd)
-		{
-			lastCommStatus = LSS_CommStatus_ReadWrongIdentifier;
-			return ((char *) nullptr);			
-		}
-		cmd++;
-		if (*cmd == '\0')
-			break;
-		c = LSS::timedRead();
+		if (buses[b].isOpen())
+			sent |= buses[b].genericWrite(id, cmd, value);
 	}
-	size_t maxLength = (LSS_MaxTotalCommandLength - 1);
-	size_t index = 0;
+	if (!sent)
+		buses[0].genericWrite(id, cmd, value);	// records WriteNoBus
+	return (sent);
+}
 
+bool LSS::genericWrite(uint8_t id, const char * cmd, int16_t value, const char * parameter, int16_t parameter_value)
+{
+	if (id != LSS_BroadcastID && id != LSS_Mode255ID)
+		return (getBusForID(id).genericWrite(id, cmd, value, parameter, parameter_value));
 
-	while (index < maxLength)
+	bool sent = false;
+	for (uint8_t b = 0; b < LSS_MaxBuses; b++)
 	{
-		c = LSS::timedRead();
-		if (c < 0 || c == LSS_CommandEnd[0])
-			break;
-		value[index] = (char) c;
-		index++;
+		if (buses[b].isOpen())
+			sent |= buses[b].genericWrite(id, cmd, value, parameter, parameter_value);
 	}
-	value[index] = '\0';
+	if (!sent)
+		buses[0].genericWrite(id, cmd, value, parameter, parameter_value);	// records WriteNoBus
+	return (sent);
+}
 
-	// Return value (success)
-	if (c < 0) 
-	{
-		// did not get the ending CR
-		lastCommStatus = LSS_CommStatus_ReadTimeout;
-		return ((char *) nullptr);
-	}
+bool LSS::genericRead(uint8_t id, const char * cmd, LSS_QueryResult & result, char * text, uint8_t text_size)
+{
+	return (getBusForID(id).genericRead(id, cmd, result, text, text_size));
+}
 
-	lastCommStatus = LSS_CommStatus_ReadSuccess;
-	return value;
+// Reply value as read; nullptr if it could not be read
+char * LSS::genericRead_Blocking_str(uint8_t id, const char * cmd)
+{
+	static char text[LSS_MaxTotalCommandLength];
+	LSS_QueryResult result;
+	if (!(LSS::genericRead(id, cmd, result, text, sizeof(text))))
+		return ((char *) nullptr);
+	return (text);
 }
 
-//==============================================================================
 int16_t LSS::genericRead_Blocking_s16(uint8_t id, const char * cmd)
 {
-	// Let the string function do all of the main parsing work.
-	char *valueStr = genericRead_Blocking_str(id, cmd);
-	if (valueStr == (char *) nullptr)
-	{
-		// the above method will have already set the error condition. 
-		return 0;
-	}
-
-	// Exit condition
-	if (bus == (Stream*) nullptr)
-	{
-		lastCommStatus = LSS_CommStatus_ReadNoBus;
-		return (0);
-	}
-
-	// convert the value string to value
-	int16_t value = 0;
-	int16_t value_sign = 1;
-	for(;;)
-	{
-		if ((*valueStr >= '0') && (*valueStr <= '9'))
-			value = value * 10 + *valueStr - '0';
-		else if (*valueStr == '-')
-			value_sign = -1;
-		else 
-			break;
-		valueStr++; 
-	}
-	// now see if we exited with valid number
-	if (*valueStr != '\0')
-	{
-		lastCommStatus = LSS_CommStatus_ReadWrongID;
-		return (0);
-	}
-	// return the computed value
-	return value * value_sign; 
-} 
-
+	LSS_QueryResult result;
+	LSS::genericRead(id, cmd, result);
+	return ((int16_t) result.value);
+}
 
 // -- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
 // Public functions (instance) ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
@@ -423,7 +1309,15 @@ void LSS::setServoID(uint8_t id)
 
 LSS_LastCommStatus LSS::getLastCommStatus(void)
 {
-	return (LSS::lastCommStatus);
+	return (this->getServoBus().getLastCommStatus());
+}
+
+// Bus used by this handle: the bound bus, else the bus the ID is routed to
+LSSBus & LSS::getServoBus(void)
+{
+	if (this->bus != (LSSBus*) nullptr)
+		return (*this->bus);
+	return (LSS::getBusForID(this->servoID));
 }
 
 // --- Actions ---
@@ -432,61 +1326,69 @@ LSS_LastCommStatus LSS::getLastCommStatus(void)
 // Note: no waiting is done here. LSS will take a bit more than a second to reset/start responding to commands.
 bool LSS::reset(void)
 {
-	return (LSS::genericWrite(this->servoID, LSS_ActionReset));
+	// Session values go back to the config ones; values broadcast to every servo no longer hold for this one either
+	if (this->servoID == LSS_BroadcastID)
+		LSS::invalidateShadow(LSS_BroadcastID);
+	else
+	{
+		LSS::shadowForget(this->servoID);
+		LSS::shadowForget(LSS_BroadcastID);
+	}
+	return (this->write(LSS_ActionReset));
 }
 
 // Make LSS limp
 bool LSS::limp(void)
 {
-	return (LSS::genericWrite(this->servoID, LSS_ActionLimp));
+	return (this->write(LSS_ActionLimp));
 }
 
 // Make LSS hold current position
 bool LSS::hold(void)
 {
-	return (LSS::genericWrite(this->servoID, LSS_ActionHold));
+	return (this->write(LSS_ActionHold));
 }
 
 // Make LSS move to specified position in 1/10°
 bool LSS::move(int16_t value)
 {
-	return (LSS::genericWrite(this->servoID, LSS_ActionMove, value));
+	return (this->write(LSS_ActionMove, value));
 }
 
 // Make LSS move to specified position in 1/10° with T parameter
 bool LSS::moveT(int16_t value, int16_t t_value)
 {
-	return (LSS::genericWrite(this->servoID, LSS_ActionMove, value, LSS_ActionParameterTime, t_value));
+	return (this->write(LSS_ActionMove, value, LSS_ActionParameterTime, t_value));
 }
 
 // Make LSS move to specified position in 1/10° with CH parameter
 bool LSS::moveCH(int16_t value, int16_t ch_value)
 {
-	return (LSS::genericWrite(this->servoID, LSS_ActionMove, value, LSS_ActionParameterCurrentHold, ch_value));
+	return (this->write(LSS_ActionMove, value, LSS_ActionParameterCurrentHold, ch_value));
 }
 
 // Perform relative move by specified amount of 1/10°
 bool LSS::moveRelative(int16_t value)
 {
-	return (LSS::genericWrite(this->servoID, LSS_ActionMoveRelative, value));
+	return (this->write(LSS_ActionMoveRelative, value));
 }
 
 // Perform relative move by specified amount of 1/10° with T parameter
 bool LSS::moveRelativeT(int16_t value, int16_t t_value)
 {
-	return (LSS::genericWrite(this->servoID, LSS_ActionMoveRelative, value, LSS_ActionParameterTime, t_value));
+	return (this->write(LSS_ActionMoveRelative, value, LSS_ActionParameterTime, t_value));
 }
 
 // Make LSS rotate at set speed in (1/10°)/s
 bool LSS::wheel(int16_t value)
 {
-	return (LSS::genericWrite(this->servoID, LSS_ActionWheel, value));
+	return (this->write(LSS_ActionWheel, value));
 }
 
 // Make LSS rotate at set speed in RPM
 bool LSS::wheelRPM(int8_t value)
 {
-	return (LSS::genericWrite(this->servoID, LSS_ActionWheelRPM, value));
+	return (this->write(LSS_ActionWheelRPM, value));
 }
 
 //> Queries
@@ -502,54 +1404,63 @@ LSS_Status LSS::getStatus(void)
 	LSS_Status value = LSS_StatusUnknown;
 
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QueryStatus)))
+	if (!(this->write(LSS_QueryStatus)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (value);
 	}
 
 	// Read response from servo
-	value = (LSS_Status) LSS::genericRead_Blocking_s16(this->servoID, LSS_QueryStatus);
+	value = (LSS_Status) this->read_s16(LSS_QueryStatus);
 
 	// Return result
 	return (value);
 }
 
 // Returns origin offset in 1/10°
-int16_t LSS::getOriginOffset(LSS_QueryType queryType)
+int16_t LSS::getOriginOffset(LSS_QueryType queryType, bool refresh)
 {
 	// Variables
 	int16_t value = 0;
+	int16_t cached;
+
+	// Served from the shadow cache when fresh
+	if (this->shadowRead(LSS_ShadowOriginOffset, queryType, refresh, cached))
+		return ((int16_t) cached);
 
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QueryOriginOffset, queryType)))
+	if (!(this->write(LSS_QueryOriginOffset, queryType)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (value);
 	}
 
 	// Read response from servo
-	value = (int16_t) LSS::genericRead_Blocking_s16(this->servoID, LSS_QueryOriginOffset);
+	value = (int16_t) this->read_s16(LSS_QueryOriginOffset);
+	this->shadowStore(LSS_ShadowOriginOffset, queryType, value);
 
 	// Return result
 	return (value);
 }
 
 // Returns angular range in 1/10°
-uint16_t LSS::getAngularRange(LSS_QueryType queryType)
+uint16_t LSS::getAngularRange(LSS_QueryType queryType, bool refresh)
 {
 	// Variables
 	uint16_t value = 0;
+	int16_t cached;
+
+	// Served from the shadow cache when fresh
+	if (this->shadowRead(LSS_ShadowAngularRange, queryType, refresh, cached))
+		return ((uint16_t) cached);
 
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QueryAngularRange, queryType)))
+	if (!(this->write(LSS_QueryAngularRange, queryType)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (value);
 	}
 
 	// Read response from servo
-	value = (uint16_t) LSS::genericRead_Blocking_s16(this->servoID, LSS_QueryAngularRange);
+	value = (uint16_t) this->read_s16(LSS_QueryAngularRange);
+	this->shadowStore(LSS_ShadowAngularRange, queryType, value);
 
 	// Return result
 	return (value);
@@ -562,14 +1473,13 @@ uint16_t LSS::getPositionPulse(void)
 	uint16_t value = 0;
 
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QueryPositionPulse)))
+	if (!(this->write(LSS_QueryPositionPulse)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (value);
 	}
 
 	// Read response from servo
-	value = (uint16_t) LSS::genericRead_Blocking_s16(this->servoID, LSS_QueryPositionPulse);
+	value = (uint16_t) this->read_s16(LSS_QueryPositionPulse);
 
 	// Return result
 	return (value);
@@ -579,32 +1489,22 @@ uint16_t LSS::getPositionPulse(void)
 int32_t LSS::getPosition(void)
 {
 	// Variables
-	char * valueStr;
-	int32_t valuePos = 0;
+	LSS_QueryResult result;
 
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QueryPosition)))
+	if (!(this->write(LSS_QueryPosition)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (0);
 	}
 
-	// Read response from servo (as string)
-	valueStr = LSS::genericRead_Blocking_str(this->servoID, LSS_QueryPosition);
-
-	// Check for disabled first position
-	if (LSS::charToInt(valueStr, &valuePos))
-	{
-		return (valuePos);
-	}
-	else
+	// Read response from servo
+	if (!(this->read(LSS_QueryPosition, result)))
 	{
-		// Unable to convert valueStr to int16_t
 		return (0);
 	}
 
 	// Return result
-	return (0);	// should not be reachable
+	return (result.value);
 }
 
 // Returns speed in (1/10°)/s
@@ -614,14 +1514,13 @@ int16_t LSS::getSpeed(void)
 	int16_t value = 0;
 
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QuerySpeed)))
+	if (!(this->write(LSS_QuerySpeed)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (value);
 	}
 
 	// Read response from servo
-	value = (int16_t) LSS::genericRead_Blocking_s16(this->servoID, LSS_QuerySpeed);
+	value = (int16_t) this->read_s16(LSS_QuerySpeed);
 
 	// Return result
 	return (value);
@@ -633,14 +1532,13 @@ int8_t LSS::getSpeedRPM(void)
 	int8_t value = 0;
 
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QuerySpeedRPM)))
+	if (!(this->write(LSS_QuerySpeedRPM)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (value);
 	}
 
 	// Read response from servo
-	value = (int8_t) LSS::genericRead_Blocking_s16(this->servoID, LSS_QuerySpeedRPM);
+	value = (int8_t) this->read_s16(LSS_QuerySpeedRPM);
 
 	// Return result
 	return (value);
@@ -652,33 +1550,37 @@ int8_t LSS::getSpeedPulse(void)
 	int8_t value = 0;
 
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QuerySpeedPulse)))
+	if (!(this->write(LSS_QuerySpeedPulse)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (value);
 	}
 
 	// Read response from servo
-	value = (int8_t) LSS::genericRead_Blocking_s16(this->servoID, LSS_QuerySpeedPulse);
+	value = (int8_t) this->read_s16(LSS_QuerySpeedPulse);
 
 	// Return result
 	return (value);
 }
 
-uint16_t LSS::getMaxSpeed(LSS_QueryType queryType)
+uint16_t LSS::getMaxSpeed(LSS_QueryType queryType, bool refresh)
 {
 	// Variables
 	uint16_t value = 0;
+	int16_t cached;
+
+	// Served from the shadow cache when fresh
+	if (this->shadowRead(LSS_ShadowMaxSpeed, queryType, refresh, cached))
+		return ((uint16_t) cached);
 
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QueryMaxSpeed, queryType)))
+	if (!(this->write(LSS_QueryMaxSpeed, queryType)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (value);
 	}
 
 	// Read response from servo
-	value = (uint16_t) LSS::genericRead_Blocking_s16(this->servoID, LSS_QueryMaxSpeed);
+	value = (uint16_t) this->read_s16(LSS_QueryMaxSpeed);
+	this->shadowStore(LSS_ShadowMaxSpeed, queryType, value);
 
 	// Return result
 	return (value);
@@ -690,52 +1592,61 @@ int8_t LSS::getMaxSpeedRPM(LSS_QueryType queryType)
 	int8_t value = 0;
 
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QueryMaxSpeedRPM, queryType)))
+	if (!(this->write(LSS_QueryMaxSpeedRPM, queryType)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (value);
 	}
 
 	// Read response from servo
-	value = (int8_t) LSS::genericRead_Blocking_s16(this->servoID, LSS_QueryMaxSpeedRPM);
+	value = (int8_t) this->read_s16(LSS_QueryMaxSpeedRPM);
 
 	// Return result
 	return (value);
 }
 
-LSS_LED_Color LSS::getColorLED(LSS_QueryType queryType)
+LSS_LED_Color LSS::getColorLED(LSS_QueryType queryType, bool refresh)
 {
 	// Variables
 	LSS_LED_Color value = LSS_LED_Black;  // was 0 but removed warning
+	int16_t cached;
  
+	// Served from the shadow cache when fresh
+	if (this->shadowRead(LSS_ShadowColorLED, queryType, refresh, cached))
+		return ((LSS_LED_Color) cached);
+
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QueryColorLED, queryType)))
+	if (!(this->write(LSS_QueryColorLED, queryType)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (value);
 	}
 
 	// Read response from servo
-	value = (LSS_LED_Color) LSS::genericRead_Blocking_s16(this->servoID, LSS_QueryColorLED);
+	value = (LSS_LED_Color) this->read_s16(LSS_QueryColorLED);
+	this->shadowStore(LSS_ShadowColorLED, queryType, value);
 
 	// Return result
 	return (value);
 }
 
-LSS_ConfigGyre LSS::getGyre(LSS_QueryType queryType)
+LSS_ConfigGyre LSS::getGyre(LSS_QueryType queryType, bool refresh)
 {
 	// Variables
 	LSS_ConfigGyre value = (LSS_ConfigGyre)0;  // Note Not a valid value for this. 
+	int16_t cached;
+
+	// Served from the shadow cache when fresh
+	if (this->shadowRead(LSS_ShadowGyre, queryType, refresh, cached))
+		return ((LSS_ConfigGyre) cached);
 
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QueryGyre, queryType)))
+	if (!(this->write(LSS_QueryGyre, queryType)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (value);
 	}
 
 	// Read response from servo
-	value = (LSS_ConfigGyre) LSS::genericRead_Blocking_s16(this->servoID, LSS_QueryGyre);
+	value = (LSS_ConfigGyre) this->read_s16(LSS_QueryGyre);
+	this->shadowStore(LSS_ShadowGyre, queryType, value);
 
 	// Return result
 	return (value);
@@ -744,19 +1655,20 @@ LSS_ConfigGyre LSS::getGyre(LSS_QueryType queryType)
 int16_t LSS::getFirstPosition(void)
 {
 	// Variables
-	char * valueStr;
-	int32_t valuePosLarger = 0;
-	int16_t valuePos = 0;
+	LSS_QueryResult result;
+	char valueStr[sizeof(LSS_FirstPositionDisabled)];
 
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QueryFirstPosition)))
+	if (!(this->write(LSS_QueryFirstPosition)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (0);
 	}
 
-	// Read response from servo (as string)
-	valueStr = LSS::genericRead_Blocking_str(this->servoID, LSS_QueryFirstPosition);
+	// Read response from servo (number, or DIS)
+	if (!(this->read(LSS_QueryFirstPosition, result, valueStr, sizeof(valueStr))))
+	{
+		return (0);
+	}
 
 	// Check for disabled first position
 	if (strcmp(valueStr, LSS_FirstPositionDisabled) == 0)
@@ -764,64 +1676,51 @@ int16_t LSS::getFirstPosition(void)
 		// First position is not defined; return 0
 		return (0);
 	}
-	else
-	{
-		if (LSS::charToInt(valueStr, &valuePosLarger))
-		{
-			valuePos = (int16_t) valuePosLarger;
-		}
-		else
-		{
-			// Unable to convert valueStr to int16_t
-			return (0);
-		}
-		return (valuePos);
-	}
 
 	// Return result
-	return (0);	// should not be reachable
+	return ((int16_t) result.value);
 }
 
 bool LSS::getIsFirstPositionEnabled(void)
 {
 	// Variables
-	char * valueStr;
+	LSS_QueryResult result;
+	char valueStr[sizeof(LSS_FirstPositionDisabled)];
 
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QueryFirstPosition)))
+	if (!(this->write(LSS_QueryFirstPosition)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (false);
 	}
 
-	// Read response from servo (as string)
-	valueStr = LSS::genericRead_Blocking_str(this->servoID, LSS_QueryFirstPosition);
-	if (lastCommStatus == LSS_CommStatus_ReadSuccess)
-	{
-		// Check if first position is disabled
-		return (strcmp(valueStr, LSS_FirstPositionDisabled));
-	}
-	else
+	// Read response from servo (number, or DIS)
+	if (!(this->read(LSS_QueryFirstPosition, result, valueStr, sizeof(valueStr))))
 	{
 		// Read was not completed;
 		return (false);
 	}
+
+	// Check if first position is disabled
+	return (strcmp(valueStr, LSS_FirstPositionDisabled) != 0);
 }
 
 LSS_Model LSS::getModel(void)
 {
 	// Variables
-	char * valueStr;
+	LSS_QueryResult result;
+	char valueStr[sizeof(LSS_MODEL_HT1)];
 
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QueryModelString)))
+	if (!(this->write(LSS_QueryModelString)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (LSS_ModelUnknown);
 	}
 
 	// Read response from servo
-	valueStr = LSS::genericRead_Blocking_str(this->servoID, LSS_QueryModelString);
+	if (!(this->read(LSS_QueryModelString, result, valueStr, sizeof(valueStr))))
+	{
+		return (LSS_ModelUnknown);
+	}
 
 	if (strcmp(valueStr, LSS_MODEL_HT1) == 0)
 	{
@@ -841,17 +1740,29 @@ LSS_Model LSS::getModel(void)
 	}
 }
 
-char * LSS::getSerialNumber(void)
+// Serial number copied into the caller's buffer; returns false if it could not be read
+bool LSS::getSerialNumber(char * serial, uint8_t size)
 {
+	// Variables
+	LSS_QueryResult result;
+
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QuerySerialNumber)))
+	if (!(this->write(LSS_QuerySerialNumber)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
-		return (nullptr);
+		return (false);
 	}
 
 	// Read response from servo
-	return (LSS::genericRead_Blocking_str(this->servoID, LSS_QuerySerialNumber));
+	return (this->read(LSS_QuerySerialNumber, result, serial, size));
+}
+
+// Former form: serial number in a shared buffer, valid until the next call; nullptr if it could not be read
+char * LSS::getSerialNumber(void)
+{
+	static char serial[LSS_MaxTotalCommandLength];
+	if (!(this->getSerialNumber(serial, sizeof(serial))))
+		return ((char *) nullptr);
+	return (serial);
 }
 
 uint16_t LSS::getFirmwareVersion(void)
@@ -860,14 +1771,13 @@ uint16_t LSS::getFirmwareVersion(void)
 	uint16_t value = 0;
 
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QueryFirmwareVersion)))
+	if (!(this->write(LSS_QueryFirmwareVersion)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (value);
 	}
 
 	// Read response from servo
-	value = (uint16_t) LSS::genericRead_Blocking_s16(this->servoID, LSS_QueryFirmwareVersion);
+	value = (uint16_t) this->read_s16(LSS_QueryFirmwareVersion);
 
 	// Return result
 	return (value);
@@ -879,14 +1789,13 @@ uint16_t LSS::getVoltage(void)
 	uint16_t value = 0;
 
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QueryVoltage)))
+	if (!(this->write(LSS_QueryVoltage)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (value);
 	}
 
 	// Read response from servo
-	value = (uint16_t) LSS::genericRead_Blocking_s16(this->servoID, LSS_QueryVoltage);
+	value = (uint16_t) this->read_s16(LSS_QueryVoltage);
 
 	// Return result
 	return (value);
@@ -898,14 +1807,13 @@ uint16_t LSS::getTemperature(void)
 	uint16_t value = 0;
 
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QueryTemperature)))
+	if (!(this->write(LSS_QueryTemperature)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (value);
 	}
 
 	// Read response from servo
-	value = (uint16_t) LSS::genericRead_Blocking_s16(this->servoID, LSS_QueryTemperature);
+	value = (uint16_t) this->read_s16(LSS_QueryTemperature);
 
 	// Return result
 	return (value);
@@ -917,128 +1825,188 @@ uint16_t LSS::getCurrent(void)
 	uint16_t value = 0;
 
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QueryCurrent)))
+	if (!(this->write(LSS_QueryCurrent)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (value);
 	}
 
 	// Read response from servo
-	value = (uint16_t) LSS::genericRead_Blocking_s16(this->servoID, LSS_QueryCurrent);
+	value = (uint16_t) this->read_s16(LSS_QueryCurrent);
 
 	// Return result
 	return (value);
 }
 
+//> Queries (non-blocking)
+int8_t LSS::request(const char * cmd, LSS_QueryCallback callback, uint16_t deadline)
+{
+	return (this->getServoBus().request(this->servoID, cmd, callback, deadline));
+}
+
+int8_t LSS::requestStatus(LSS_QueryCallback callback)
+{
+	return (this->request(LSS_QueryStatus, callback));
+}
+
+int8_t LSS::requestPosition(LSS_QueryCallback callback)
+{
+	return (this->request(LSS_QueryPosition, callback));
+}
+
+int8_t LSS::requestVoltage(LSS_QueryCallback callback)
+{
+	return (this->request(LSS_QueryVoltage, callback));
+}
+
+int8_t LSS::requestTemperature(LSS_QueryCallback callback)
+{
+	return (this->request(LSS_QueryTemperature, callback));
+}
+
+int8_t LSS::requestCurrent(LSS_QueryCallback callback)
+{
+	return (this->request(LSS_QueryCurrent, callback));
+}
+
 //> Queries (advanced)
-int8_t LSS::getAngularStiffness(LSS_QueryType queryType)
+int8_t LSS::getAngularStiffness(LSS_QueryType queryType, bool refresh)
 {
 	// Variables
 	int8_t value = 0;
+	int16_t cached;
+
+	// Served from the shadow cache when fresh
+	if (this->shadowRead(LSS_ShadowAngularStiffness, queryType, refresh, cached))
+		return ((int8_t) cached);
 
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QueryAngularStiffness, queryType)))
+	if (!(this->write(LSS_QueryAngularStiffness, queryType)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (value);
 	}
 
 	// Read response from servo
-	value = (int8_t) LSS::genericRead_Blocking_s16(this->servoID, LSS_QueryAngularStiffness);
+	value = (int8_t) this->read_s16(LSS_QueryAngularStiffness);
+	this->shadowStore(LSS_ShadowAngularStiffness, queryType, value);
 
 	// Return result
 	return (value);
 }
 
-int8_t LSS::getAngularHoldingStiffness(LSS_QueryType queryType)
+int8_t LSS::getAngularHoldingStiffness(LSS_QueryType queryType, bool refresh)
 {
 	// Variables
 	int8_t value = 0;
+	int16_t cached;
+
+	// Served from the shadow cache when fresh
+	if (this->shadowRead(LSS_ShadowAngularHoldingStiffness, queryType, refresh, cached))
+		return ((int8_t) cached);
 
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QueryAngularHoldingStiffness, queryType)))
+	if (!(this->write(LSS_QueryAngularHoldingStiffness, queryType)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (value);
 	}
 
 	// Read response from servo
-	value = (int8_t) LSS::genericRead_Blocking_s16(this->servoID, LSS_QueryAngularHoldingStiffness);
+	value = (int8_t) this->read_s16(LSS_QueryAngularHoldingStiffness);
+	this->shadowStore(LSS_ShadowAngularHoldingStiffness, queryType, value);
 
 	// Return result
 	return (value);
 }
 
-int16_t LSS::getAngularAcceleration(LSS_QueryType queryType)
+int16_t LSS::getAngularAcceleration(LSS_QueryType queryType, bool refresh)
 {
 	// Variables
 	int16_t value = 0;
+	int16_t cached;
+
+	// Served from the shadow cache when fresh
+	if (this->shadowRead(LSS_ShadowAngularAcceleration, queryType, refresh, cached))
+		return ((int16_t) cached);
 
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QueryAngularAcceleration, queryType)))
+	if (!(this->write(LSS_QueryAngularAcceleration, queryType)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (value);
 	}
 
 	// Read response from servo
-	value = (int16_t) LSS::genericRead_Blocking_s16(this->servoID, LSS_QueryAngularAcceleration);
+	value = (int16_t) this->read_s16(LSS_QueryAngularAcceleration);
+	this->shadowStore(LSS_ShadowAngularAcceleration, queryType, value);
 
 	// Return result
 	return (value);
 }
 
-int16_t LSS::getAngularDeceleration(LSS_QueryType queryType)
+int16_t LSS::getAngularDeceleration(LSS_QueryType queryType, bool refresh)
 {
 	// Variables
 	int16_t value = 0;
+	int16_t cached;
+
+	// Served from the shadow cache when fresh
+	if (this->shadowRead(LSS_ShadowAngularDeceleration, queryType, refresh, cached))
+		return ((int16_t) cached);
 
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QueryAngularDeceleration, queryType)))
+	if (!(this->write(LSS_QueryAngularDeceleration, queryType)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (value);
 	}
 
 	// Read response from servo
-	value = (int16_t) LSS::genericRead_Blocking_s16(this->servoID, LSS_QueryAngularDeceleration);
+	value = (int16_t) this->read_s16(LSS_QueryAngularDeceleration);
+	this->shadowStore(LSS_ShadowAngularDeceleration, queryType, value);
 
 	// Return result
 	return (value);
 }
 
-bool LSS::getIsMotionControlEnabled(void)
+bool LSS::getIsMotionControlEnabled(bool refresh)
 {
 	// Variables
 	bool value = 0;
+	int16_t cached;
+
+	// Served from the shadow cache when fresh
+	if (this->shadowRead(LSS_ShadowMotionControl, LSS_QuerySession, refresh, cached))
+		return ((bool) cached);
 
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QueryEnableMotionControl)))
+	if (!(this->write(LSS_QueryEnableMotionControl)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (value);
 	}
 
 	// Read response from servo
-	value = (bool) LSS::genericRead_Blocking_s16(this->servoID, LSS_QueryEnableMotionControl);
+	value = (bool) this->read_s16(LSS_QueryEnableMotionControl);
+	this->shadowStore(LSS_ShadowMotionControl, LSS_QuerySession, value);
 
 	// Return result
 	return (value);
 }
 
-int16_t LSS::getFilterPositionCount(LSS_QueryType queryType) {
+int16_t LSS::getFilterPositionCount(LSS_QueryType queryType, bool refresh) {
 	// Variables
 	int16_t value = 0;
+	int16_t cached;
+
+	// Served from the shadow cache when fresh
+	if (this->shadowRead(LSS_ShadowFilterPositionCount, queryType, refresh, cached))
+		return ((int16_t) cached);
 
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QueryFilterPositionCount, queryType)))
+	if (!(this->write(LSS_QueryFilterPositionCount, queryType)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (value);
 	}
 
 	// Read response from servo
-	value = (int16_t) LSS::genericRead_Blocking_s16(this->servoID, LSS_QueryFilterPositionCount);
+	value = (int16_t) this->read_s16(LSS_QueryFilterPositionCount);
+	this->shadowStore(LSS_ShadowFilterPositionCount, queryType, value);
 
 	// Return result
 	return (value);
@@ -1051,14 +2019,13 @@ uint8_t LSS::getBlinkingLED(void)
 	uint8_t value = 0;
 
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QueryBlinkingLED)))
+	if (!(this->write(LSS_QueryBlinkingLED)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (value);
 	}
 
 	// Read response from servo
-	value = (uint8_t) LSS::genericRead_Blocking_s16(this->servoID, LSS_QueryBlinkingLED);
+	value = (uint8_t) this->read_s16(LSS_QueryBlinkingLED);
 
 	// Return result
 	return (value);
@@ -1070,14 +2037,13 @@ uint16_t LSS::getAnalog(void)
 	uint16_t value = 0;
 
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QueryAnalog)))
+	if (!(this->write(LSS_QueryAnalog)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (value);
 	}
 
 	// Read response from servo
-	value = (uint16_t) LSS::genericRead_Blocking_s16(this->servoID, LSS_QueryAnalog);
+	value = (uint16_t) this->read_s16(LSS_QueryAnalog);
 
 	// Return result
 	return (value);
@@ -1089,14 +2055,13 @@ uint16_t LSS::getDistance_mm(LSS_QueryTypeDistance queryTypeDistance)
 	uint16_t value = 0;
 
 	// Ask servo for status; exit if it failed
-	if (!(LSS::genericWrite(this->servoID, LSS_QueryAnalog, queryTypeDistance)))
+	if (!(this->write(LSS_QueryAnalog, queryTypeDistance)))
 	{
-		LSS::lastCommStatus = LSS_CommStatus_WriteNoBus;
 		return (value);
 	}
 
 	// Read response from servo
-	value = (uint16_t) LSS::genericRead_Blocking_s16(this->servoID, LSS_QueryAnalog);
+	value = (uint16_t) this->read_s16(LSS_QueryAnalog);
 
 	// Return result
 	return (value);
@@ -1109,12 +2074,12 @@ bool LSS::setOriginOffset(int16_t value, LSS_SetType setType)
 	{
 		case (LSS_SetSession):
 		{
-			return (LSS::genericWrite(this->servoID, LSS_ActionOriginOffset, value));
+			return (this->shadowWrite(LSS_ShadowOriginOffset, LSS_SetSession, this->write(LSS_ActionOriginOffset, value), value));
 			break;
 		}
 		case (LSS_SetConfig):
 		{
-			return (LSS::genericWrite(this->servoID, LSS_ConfigOriginOffset, value));
+			return (this->shadowWrite(LSS_ShadowOriginOffset, LSS_SetConfig, this->write(LSS_ConfigOriginOffset, value), value));
 			break;
 		}
 	}
@@ -1129,12 +2094,12 @@ bool LSS::setAngularRange(uint16_t value, LSS_SetType setType)
 	{
 		case (LSS_SetSession):
 		{
-			return (LSS::genericWrite(this->servoID, LSS_ActionAngularRange, value));
+			return (this->shadowWrite(LSS_ShadowAngularRange, LSS_SetSession, this->write(LSS_ActionAngularRange, value), value));
 			break;
 		}
 		case (LSS_SetConfig):
 		{
-			return (LSS::genericWrite(this->servoID, LSS_ConfigAngularRange, value));
+			return (this->shadowWrite(LSS_ShadowAngularRange, LSS_SetConfig, this->write(LSS_ConfigAngularRange, value), value));
 			break;
 		}
 	}
@@ -1147,12 +2112,12 @@ bool LSS::setMaxSpeed(uint16_t value, LSS_SetType setType)
 	{
 		case (LSS_SetSession):
 		{
-			return (LSS::genericWrite(this->servoID, LSS_ActionMaxSpeed, value));
+			return (this->shadowWrite(LSS_ShadowMaxSpeed, LSS_SetSession, this->write(LSS_ActionMaxSpeed, value), value));
 			break;
 		}
 		case (LSS_SetConfig):
 		{
-			return (LSS::genericWrite(this->servoID, LSS_ConfigMaxSpeed, value));
+			return (this->shadowWrite(LSS_ShadowMaxSpeed, LSS_SetConfig, this->write(LSS_ConfigMaxSpeed, value), value));
 			break;
 		}
 	}
@@ -1165,12 +2130,14 @@ bool LSS::setMaxSpeedRPM(int8_t value, LSS_SetType setType)
 	{
 		case (LSS_SetSession):
 		{
-			return (LSS::genericWrite(this->servoID, LSS_ActionMaxSpeedRPM, value));
+			this->shadowWrite(LSS_ShadowMaxSpeed, LSS_SetConfig, false, 0);		// forget the max speed, now set in rpm
+			return (this->write(LSS_ActionMaxSpeedRPM, value));
 			break;
 		}
 		case (LSS_SetConfig):
 		{
-			return (LSS::genericWrite(this->servoID, LSS_ConfigMaxSpeedRPM, value));
+			this->shadowWrite(LSS_ShadowMaxSpeed, LSS_SetConfig, false, 0);
+			return (this->write(LSS_ConfigMaxSpeedRPM, value));
 			break;
 		}
 	}
@@ -1183,12 +2150,12 @@ bool LSS::setColorLED(LSS_LED_Color value, LSS_SetType setType)
 	{
 		case (LSS_SetSession):
 		{
-			return (LSS::genericWrite(this->servoID, LSS_ActionColorLED, value));
+			return (this->shadowWrite(LSS_ShadowColorLED, LSS_SetSession, this->write(LSS_ActionColorLED, value), value));
 			break;
 		}
 		case (LSS_SetConfig):
 		{
-			return (LSS::genericWrite(this->servoID, LSS_ConfigColorLED, value));
+			return (this->shadowWrite(LSS_ShadowColorLED, LSS_SetConfig, this->write(LSS_ConfigColorLED, value), value));
 			break;
 		}
 	}
@@ -1201,12 +2168,12 @@ bool LSS::setGyre(LSS_ConfigGyre value, LSS_SetType setType)
 	{
 		case (LSS_SetSession):
 		{
-			return (LSS::genericWrite(this->servoID, LSS_ActionGyreDirection, value));
+			return (this->shadowWrite(LSS_ShadowGyre, LSS_SetSession, this->write(LSS_ActionGyreDirection, value), value));
 			break;
 		}
 		case (LSS_SetConfig):
 		{
-			return (LSS::genericWrite(this->servoID, LSS_ConfigGyreDirection, value));
+			return (this->shadowWrite(LSS_ShadowGyre, LSS_SetConfig, this->write(LSS_ConfigGyreDirection, value), value));
 			break;
 		}
 	}
@@ -1215,17 +2182,17 @@ bool LSS::setGyre(LSS_ConfigGyre value, LSS_SetType setType)
 
 bool LSS::setFirstPosition(int16_t value)
 {
-	return (LSS::genericWrite(this->servoID, LSS_ConfigFirstPosition, value));
+	return (this->write(LSS_ConfigFirstPosition, value));
 }
 
 bool LSS::clearFirstPosition(void)
 {
-	return (LSS::genericWrite(this->servoID, LSS_ConfigFirstPosition));
+	return (this->write(LSS_ConfigFirstPosition));
 }
 
 bool LSS::setMode(LSS_ConfigMode value)
 {
-	return (LSS::genericWrite(this->servoID, LSS_ConfigModeRC, value));
+	return (this->write(LSS_ConfigModeRC, value));
 }
 
 //> Configs (advanced)
@@ -1235,12 +2202,12 @@ bool LSS::setAngularStiffness(int8_t value, LSS_SetType setType)
 	{
 		case (LSS_SetSession):
 		{
-			return (LSS::genericWrite(this->servoID, LSS_ActionAngularStiffness, value));
+			return (this->shadowWrite(LSS_ShadowAngularStiffness, LSS_SetSession, this->write(LSS_ActionAngularStiffness, value), value));
 			break;
 		}
 		case (LSS_SetConfig):
 		{
-			return (LSS::genericWrite(this->servoID, LSS_ConfigAngularStiffness, value));
+			return (this->shadowWrite(LSS_ShadowAngularStiffness, LSS_SetConfig, this->write(LSS_ConfigAngularStiffness, value), value));
 			break;
 		}
 	}
@@ -1253,12 +2220,12 @@ bool LSS::setAngularHoldingStiffness(int8_t value, LSS_SetType setType)
 	{
 		case (LSS_SetSession):
 		{
-			return (LSS::genericWrite(this->servoID, LSS_ActionAngularHoldingStiffness, value));
+			return (this->shadowWrite(LSS_ShadowAngularHoldingStiffness, LSS_SetSession, this->write(LSS_ActionAngularHoldingStiffness, value), value));
 			break;
 		}
 		case (LSS_SetConfig):
 		{
-			return (LSS::genericWrite(this->servoID, LSS_ConfigAngularHoldingStiffness, value));
+			return (this->shadowWrite(LSS_ShadowAngularHoldingStiffness, LSS_SetConfig, this->write(LSS_ConfigAngularHoldingStiffness, value), value));
 			break;
 		}
 	}
@@ -1271,12 +2238,12 @@ bool LSS::setAngularAcceleration(int16_t value, LSS_SetType setType)
 	{
 		case (LSS_SetSession):
 		{
-			return (LSS::genericWrite(this->servoID, LSS_ActionAngularAcceleration, value));
+			return (this->shadowWrite(LSS_ShadowAngularAcceleration, LSS_SetSession, this->write(LSS_ActionAngularAcceleration, value), value));
 			break;
 		}
 		case (LSS_SetConfig):
 		{
-			return (LSS::genericWrite(this->servoID, LSS_ConfigAngularAcceleration, value));
+			return (this->shadowWrite(LSS_ShadowAngularAcceleration, LSS_SetConfig, this->write(LSS_ConfigAngularAcceleration, value), value));
 			break;
 		}
 	}
@@ -1289,12 +2256,12 @@ bool LSS::setAngularDeceleration(int16_t value, LSS_SetType setType)
 	{
 		case (LSS_SetSession):
 		{
-			return (LSS::genericWrite(this->servoID, LSS_ActionAngularDeceleration, value));
+			return (this->shadowWrite(LSS_ShadowAngularDeceleration, LSS_SetSession, this->write(LSS_ActionAngularDeceleration, value), value));
 			break;
 		}
 		case (LSS_SetConfig):
 		{
-			return (LSS::genericWrite(this->servoID, LSS_ConfigAngularDeceleration, value));
+			return (this->shadowWrite(LSS_ShadowAngularDeceleration, LSS_SetConfig, this->write(LSS_ConfigAngularDeceleration, value), value));
 			break;
 		}
 	}
@@ -1303,7 +2270,7 @@ bool LSS::setAngularDeceleration(int16_t value, LSS_SetType setType)
 
 bool LSS::setMotionControlEnabled(bool value)
 {
-	return (LSS::genericWrite(this->servoID, LSS_ActionEnableMotionControl, value));
+	return (this->shadowWrite(LSS_ShadowMotionControl, LSS_SetSession, this->write(LSS_ActionEnableMotionControl, value), value));
 }
 
 bool LSS::setFilterPositionCount(int16_t value, LSS_SetType setType)
@@ -1313,12 +2280,12 @@ bool LSS::setFilterPositionCount(int16_t value, LSS_SetType setType)
 	{
 		case (LSS_SetSession):
 		{
-			return (LSS::genericWrite(this->servoID, LSS_FilterPositionCount, value));
+			return (this->shadowWrite(LSS_ShadowFilterPositionCount, LSS_SetSession, this->write(LSS_FilterPositionCount, value), value));
 			break;
 		}
 		case (LSS_SetConfig):
 		{
-			return (LSS::genericWrite(this->servoID, LSS_ConfigFilterPositionCount, value));
+			return (this->shadowWrite(LSS_ShadowFilterPositionCount, LSS_SetConfig, this->write(LSS_ConfigFilterPositionCount, value), value));
 			break;
 		}
 	}
@@ -1328,7 +2295,7 @@ bool LSS::setFilterPositionCount(int16_t value, LSS_SetType setType)
 
 bool LSS::setBlinkingLED(uint8_t value)
 {
-	return (LSS::genericWrite(this->servoID, LSS_ConfigBlinkingLED, value));
+	return (this->write(LSS_ConfigBlinkingLED, value));
 }
 
 // -- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
@@ -1342,8 +2309,158 @@ bool LSS::setBlinkingLED(uint8_t value)
 
 // -- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
 // Private functions (instance)     ---- ---- ---- ---- ---- ---- ---- ---- ----
-/*
- void LSS::?????(void)
- {
- }
- */
+
+// Write on the bound bus, or route through the class shims (handles broadcast on every bus)
+bool LSS::write(const char * cmd)
+{
+	if (this->bus != (LSSBus*) nullptr)
+		return (this->bus->genericWrite(this->servoID, cmd));
+	return (LSS::genericWrite(this->servoID, cmd));
+}
+
+bool LSS::write(const char * cmd, int16_t value)
+{
+	if (this->bus != (LSSBus*) nullptr)
+		return (this->bus->genericWrite(this->servoID, cmd, value));
+	return (LSS::genericWrite(this->servoID, cmd, value));
+}
+
+bool LSS::write(const char * cmd, int16_t value, const char * parameter, int16_t parameter_value)
+{
+	if (this->bus != (LSSBus*) nullptr)
+		return (this->bus->genericWrite(this->servoID, cmd, value, parameter, parameter_value));
+	return (LSS::genericWrite(this->servoID, cmd, value, parameter, parameter_value));
+}
+
+bool LSS::read(const char * cmd, LSS_QueryResult & result, char * text, uint8_t text_size)
+{
+	return (this->getServoBus().genericRead(this->servoID, cmd, result, text, text_size));
+}
+
+int16_t LSS::read_s16(const char * cmd)
+{
+	LSS_QueryResult result;
+	this->read(cmd, result);
+	return ((int16_t) result.value);
+}
+
+// Shadow cache lookup: own value first, then a value broadcast to every servo
+bool LSS::shadowRead(LSS_ShadowField field, LSS_QueryType queryType, bool refresh, int16_t & value)
+{
+#ifdef LSS_SupportShadowCache
+	if (refresh || shadowTTL[field] == 0)
+		return (false);
+	uint8_t key = field | (queryType == LSS_QueryConfig ? LSS_ShadowConfig : 0);
+	uint32_t now = millis();
+	int8_t own = -1, all = -1;
+	for (uint8_t i = 0; i < LSS_ShadowEntries; i++)
+	{
+		if (!shadow[i].valid || shadow[i].field != key)
+			continue;
+		if (shadow[i].id == this->servoID)
+			own = i;
+		else if (shadow[i].id == LSS_BroadcastID)
+			all = i;
+	}
+	// A broadcast only counts for a servo that was not set or read since
+	int8_t found = (own >= 0) ? own : all;
+	if (found < 0 || now - shadow[found].timestamp >= shadowTTL[field])
+		return (false);
+	value = shadow[found].value;
+	return (true);
+#else
+	(void) field;
+	(void) queryType;
+	(void) refresh;
+	(void) value;
+	return (false);
+#endif
+}
+
+// Remember a value read from the servo
+void LSS::shadowStore(LSS_ShadowField field, LSS_QueryType queryType, int16_t value)
+{
+#ifdef LSS_SupportShadowCache
+	if (this->getLastCommStatus() != LSS_CommStatus_ReadSuccess)
+		return;
+	if (queryType != LSS_QuerySession && queryType != LSS_QueryConfig)
+		return;
+	uint8_t key = field | (queryType == LSS_QueryConfig ? LSS_ShadowConfig : 0);
+	int8_t slot = -1;
+	for (uint8_t i = 0; i < LSS_ShadowEntries; i++)
+	{
+		if (shadow[i].valid && shadow[i].id == this->servoID && shadow[i].field == key)
+		{
+			slot = i;
+			break;
+		}
+		// Free entry, else the oldest one
+		if (slot < 0 || (shadow[slot].valid && (!shadow[i].valid || (int32_t) (shadow[i].timestamp - shadow[slot].timestamp) < 0)))
+			slot = i;
+	}
+	shadow[slot].valid = true;
+	shadow[slot].id = this->servoID;
+	shadow[slot].field = key;
+	shadow[slot].value = value;
+	shadow[slot].timestamp = millis();
+#else
+	(void) field;
+	(void) queryType;
+	(void) value;
+#endif
+}
+
+// Remember a value written to the servo(s); returns written.
+// A config write does not say what the session value is until a reset, so that one is forgotten.
+bool LSS::shadowWrite(LSS_ShadowField field, LSS_SetType setType, bool written, int16_t value)
+{
+#ifdef LSS_SupportShadowCache
+	for (uint8_t i = 0; i < LSS_ShadowEntries; i++)
+	{
+		if (!shadow[i].valid || (shadow[i].field & ~LSS_ShadowConfig) != field)
+			continue;
+		bool same_plane = ((shadow[i].field & LSS_ShadowConfig) != 0) == (setType == LSS_SetConfig);
+		// A broadcast replaces the value of every servo
+		if ((shadow[i].id == this->servoID || this->servoID == LSS_BroadcastID) && (same_plane || setType == LSS_SetConfig))
+			shadow[i].valid = false;
+	}
+	if (written)
+	{
+		LSS_ShadowEntry * entry = (LSS_ShadowEntry *) nullptr;
+		for (uint8_t i = 0; i < LSS_ShadowEntries; i++)
+		{
+			if (!shadow[i].valid)
+			{
+				entry = &shadow[i];
+				break;
+			}
+			if (entry == (LSS_ShadowEntry *) nullptr || (int32_t) (shadow[i].timestamp - entry->timestamp) < 0)
+				entry = &shadow[i];
+		}
+		entry->valid = true;
+		entry->id = this->servoID;
+		entry->field = field | (setType == LSS_SetConfig ? LSS_ShadowConfig : 0);
+		entry->value = value;
+		entry->timestamp = millis();
+	}
+#else
+	(void) field;
+	(void) setType;
+	(void) value;
+#endif
+	return (written);
+}
+
+// Forget the cached values stored under this exact ID (LSS_BroadcastID: only the broadcast ones)
+void LSS::shadowForget(uint8_t id)
+{
+#ifdef LSS_SupportShadowCache
+	for (uint8_t i = 0; i < LSS_ShadowEntries; i++)
+	{
+		if (shadow[i].id == id)
+			shadow[i].valid = false;
+	}
+#else
+	(void) id;
+#endif
+}
@@ -17,6 +17,26 @@
 // By default, if you are not using SoftwareSerial anywhere, the compiler should remove it anyway.
 #undef LSS_SupportSoftwareSerial
 
+#define LSS_SupportShadowCache
+// Uncomment the line below to disable the shadow cache: every getter then asks the servo. Frees LSS_ShadowEntries * 12 bytes of RAM.
+//#undef LSS_SupportShadowCache
+
+#define LSS_SupportBusStats
+// Uncomment the line below to disable the bus health counters. Frees (LSS_MaxStatsEntries + 1) * 27 bytes of RAM per bus.
+//#undef LSS_SupportBusStats
+
+#define LSS_SupportAdaptiveTimeouts
+// Uncomment the line below to disable the reply latency estimates: every read then waits up to the fixed timeout. Frees LSS_MaxRTTEntries * 11 bytes of RAM per bus.
+//#undef LSS_SupportAdaptiveTimeouts
+
+// The AVR boards (ex: LSS-2IO, ATmega328P) only have 2 KB of RAM: the tables above are left out there.
+// Comment out the lines below to use them anyway.
+#if defined(__AVR__)
+#undef LSS_SupportShadowCache
+#undef LSS_SupportBusStats
+#undef LSS_SupportAdaptiveTimeouts
+#endif
+
 // Ensure compatibility
 #if (ARDUINO >= 100)
 #include "Arduino.h"
@@ -48,11 +68,32 @@
 #define LSS_DefaultBaud				(115200)
 #define LSS_MaxTotalCommandLength	(30 + 1)	// ex: #999XXXX-2147483648\r; Adding 1 for end string char (\0)
 // ex: #999XX000000000000000000\r;
-#define LSS_Timeout					100		// in ms
+#define LSS_Timeout					100		// in ms, reply timeout for a servo without latency estimate
+#define LSS_MinReplyTimeout			500		// in us, lower bound of the adaptive reply timeout
+#define LSS_MaxRTTEntries			12		// servos with a latency estimate, per bus
+#define LSS_MaxStatsEntries			12		// servos with their own health counters, per bus
 #define LSS_CommandStart			("#")
 #define LSS_CommandReplyStart		("*")
 #define LSS_CommandEnd				("\r")
 #define LSS_FirstPositionDisabled	("DIS")
+#define LSS_ResetTime				1500	// in ms, time for the servos to reboot after a RESET
+#define LSS_MoveCommandLength		(9)		// ex: #11D-450\r, used to estimate the bus frame rate
+#if defined(ARDUINO_ARCH_AVR)
+#define LSS_MaxBaud					(250000)	// fastest LSS baud the 16 MHz AVR UART generates without error
+#else
+#define LSS_MaxBaud					(500000)
+#endif
+#if defined(__AVR__)
+#define LSS_MaxBuses				(1)		// number of serial ports the servos can be split across (a bus takes ~100 bytes of RAM)
+#else
+#define LSS_MaxBuses				(2)
+#endif
+#define LSS_IDGroups				((LSS_ID_Max / 10) + 1)	// IDs are mapped to a bus by their tens digit (ex: leg number)
+#define LSS_MaxPendingQueries		(4)		// non-blocking queries in flight per bus
+#define LSS_QueryDeadline			(10)	// in ms, default time a servo has to answer a non-blocking query
+#define LSS_MaxQueryLength			(4)		// ex: QFPC
+#define LSS_MaxValueDigits			(10)	// ex: -2147483648
+#define LSS_MaxReplyText			(16)	// reply value kept as text for the non-blocking queries, ex: LSS-HS1 (QMS)
 
 //> Servo constants
 #define LSS_ID_Default				(0)
@@ -76,6 +117,14 @@ enum LSS_LastCommStatus
 	LSS_CommStatus_WriteUnknown
 };
 
+enum LSS_BusType
+{
+	LSS_BusNone,
+	LSS_BusHardwareSerial,
+	LSS_BusSoftwareSerial,
+	LSS_BusStream		// attached by the user (ex: emulated stream), never closed by the library
+};
+
 enum LSS_Status
 {
 	LSS_StatusUnknown,
@@ -235,23 +284,229 @@ enum LSS_LED_Color
 #define LSS_ConfigAngularDeceleration		("CAD")
 #define LSS_ConfigBlinkingLED				("CLB")
 
+//> Shadow cache: last value configured or read, per servo ID and field
+#define LSS_ShadowEntries			24		// (ID, field) pairs remembered, the oldest is replaced
+#define LSS_ShadowDefaultTTL		5000	// in ms
+#define LSS_ShadowConfig			0x80	// field flag: value of the config (not session) plane
+enum LSS_ShadowField
+{
+	LSS_ShadowOriginOffset,
+	LSS_ShadowAngularRange,
+	LSS_ShadowMaxSpeed,
+	LSS_ShadowColorLED,
+	LSS_ShadowGyre,
+	LSS_ShadowAngularStiffness,
+	LSS_ShadowAngularHoldingStiffness,
+	LSS_ShadowAngularAcceleration,
+	LSS_ShadowAngularDeceleration,
+	LSS_ShadowMotionControl,
+	LSS_ShadowFilterPositionCount,
+	LSS_ShadowFields
+};
+
+struct LSS_ShadowEntry
+{
+	bool valid;						// false: free
+	uint8_t id;						// servo ID, LSS_BroadcastID: value broadcast to every servo
+	uint8_t field;					// LSS_ShadowField | LSS_ShadowConfig
+	int16_t value;
+	uint32_t timestamp;				// millis() when configured or read
+};
+
+//> Non-blocking queries
+struct LSS_QueryResult
+{
+	uint8_t id;
+	char cmd[LSS_MaxQueryLength + 1];
+	int32_t value;
+	LSS_LastCommStatus status;		// ReadSuccess, ReadTimeout (deadline passed) or ReadWrongFormat
+	uint32_t timestamp;				// millis() when the query completed
+};
+
+typedef void (*LSS_QueryCallback)(const LSS_QueryResult & result);
+
+struct LSS_PendingQuery
+{
+	LSS_QueryResult result;
+	LSS_QueryCallback callback;		// nullptr: result is polled with LSSBus::getResult
+	uint32_t deadline;				// millis()
+	uint8_t order;					// issue order, replies to the same ID are matched oldest first
+	uint32_t sent;					// micros() when the query was written
+	bool busy;
+	bool done;
+};
+
+//> Reply latency (write to end of reply), smoothed per servo ID
+struct LSS_RTT
+{
+	uint8_t id;
+	uint16_t samples;
+	uint32_t srtt;					// in us, smoothed round trip time
+	uint32_t rttvar;				// in us, smoothed mean deviation
+};
+
+//> Bus health counters, per servo ID and for the whole bus (wrap around when full)
+struct LSS_BusStats
+{
+	uint8_t id;						// LSS_BroadcastID: whole bus
+	uint16_t writes;				// commands written
+	uint32_t bytes;					// bytes written
+	uint16_t reads;					// replies expected (blocking reads and non-blocking queries)
+	uint16_t timeouts;
+	uint16_t wrongID;
+	uint16_t wrongIdentifier;
+	uint16_t wrongFormat;
+	uint16_t latencyMin;			// in us, write to end of reply
+	uint16_t latencyMax;
+	uint32_t latencySum;			// latencyAverage = latencySum / latencySamples
+	uint16_t latencySamples;
+};
+
+// Reply value decoded one character at a time (see LSSBus::genericRead)
+struct LSS_ValueDecoder
+{
+	int32_t value;
+	uint8_t digits;
+	bool negative;
+	bool valid;
+};
+
+enum LSS_ReplyParserState
+{
+	LSS_ReplyWaitStart,
+	LSS_ReplyID,
+	LSS_ReplyCommand,
+	LSS_ReplyValue,
+	LSS_ReplySkip
+};
+
+// A servo bus: owns its stream, reply buffer and communication status.
+// Several buses can be used at once (ex: one per UART, or emulated streams on a host).
+class LSSBus
+{
+public:
+	LSSBus();
+
+#ifdef LSS_SupportSoftwareSerial
+	void initBus(SoftwareSerial & s, uint32_t baud);
+#endif
+	void initBus(HardwareSerial & s, uint32_t baud);
+	void attach(Stream & s);
+	void closeBus(void);
+	bool isOpen(void);
+	void setBaud(uint32_t baud);
+	uint32_t getBaud(void);
+	Stream * getStream(void);
+	LSS_LastCommStatus getLastCommStatus(void);
+	void setReadTimeouts(uint32_t start_response_timeout=LSS_Timeout, uint32_t msg_char_timeout=LSS_Timeout);
+	int timedRead(void);
+	bool genericWrite(uint8_t id, const char * cmd);
+	bool genericWrite(uint8_t id, const char * cmd, int16_t value);
+	bool genericWrite(uint8_t id, const char * cmd, int16_t value, const char * parameter, int16_t parameter_value);
+	bool genericRead(uint8_t id, const char * cmd, LSS_QueryResult & result, char * text = nullptr, uint8_t text_size = 0);
+
+	//> Baud rate management
+	void flushInput(void);
+	bool configBaud(uint8_t id, uint32_t baud);
+	uint32_t probeBaud(uint8_t id, uint32_t first_baud = LSS_DefaultBaud);
+	uint8_t verify(const uint8_t * ids, uint8_t count);
+	uint32_t upgradeBaud(const uint8_t * ids, uint8_t count, uint32_t start_baud, uint32_t max_baud = LSS_MaxBaud);
+
+	//> Non-blocking queries
+	// Do not mix with the blocking reads on the same bus while queries are pending:
+	// a blocking read would consume their replies.
+	int8_t request(uint8_t id, const char * cmd, LSS_QueryCallback callback = nullptr, uint16_t deadline = LSS_QueryDeadline);
+	int8_t request(uint8_t id, const char * cmd, LSS_QueryType queryType, LSS_QueryCallback callback = nullptr, uint16_t deadline = LSS_QueryDeadline);
+	void poll(void);
+	bool getResult(int8_t handle, LSS_QueryResult & result);
+	uint8_t pendingQueries(void);
+	const char * getReplyText(void);
+
+	//> Reply latency
+	uint32_t getReplyTimeout(uint8_t id);
+	const LSS_RTT * getRTT(uint8_t id);
+	uint8_t getRTTCount(void);
+	const LSS_RTT & getRTTEntry(uint8_t index);
+	void resetRTT(void);
+
+	//> Health counters (see LSS_BusStats)
+	bool getStats(uint8_t id, LSS_BusStats & stats);
+	uint8_t getStatsCount(void);
+	const LSS_BusStats & getStatsEntry(uint8_t index);
+	void resetStats(void);
+
+private:
+	void feedReply(char c);
+	void completeQuery(int8_t slot, LSS_LastCommStatus status);
+	void addRTTSample(uint8_t id, uint32_t rtt);
+	bool readDone(LSS_QueryResult & result, LSS_LastCommStatus status, uint32_t latency = 0);
+	void countWrite(uint8_t id, size_t bytes);
+	void countRead(uint8_t id, LSS_LastCommStatus status, uint32_t latency = 0);
+	void countError(uint8_t id, LSS_LastCommStatus status);
+
+	LSS_BusType busType;
+	Stream * stream;
+	uint32_t baud;
+	LSS_LastCommStatus lastCommStatus;
+	uint32_t _start_response_timeout;	// in ms, used until a servo has a latency estimate
+	uint32_t _msg_char_timeout;   // timeout waiting for characters inside of packet
+	uint32_t writeTime;				// micros() of the last command written
+	uint32_t readDeadline;			// micros() deadline of the blocking read in progress
+#ifdef LSS_SupportAdaptiveTimeouts
+	LSS_RTT rtt[LSS_MaxRTTEntries];
+	uint8_t rttCount;
+	uint8_t rttNext;
+#endif
+#ifdef LSS_SupportBusStats
+	LSS_BusStats busStats;
+	LSS_BusStats stats[LSS_MaxStatsEntries];
+	uint8_t statsCount;
+	uint8_t statsNext;
+#endif
+	// Non-blocking queries
+	LSS_PendingQuery pending[LSS_MaxPendingQueries];
+	uint8_t pendingOrder;
+	LSS_ReplyParserState rxState;
+	uint8_t rxID;
+	int8_t rxSlot;
+	uint8_t rxIndex;
+	LSS_ValueDecoder rxDecoder;
+	char rxText[LSS_MaxReplyText + 1];
+	uint8_t rxTextLength;
+};
+
 // library interface description
 class LSS
 {
 public:
 	// Public functions - Class
+	// These operate on the library buses (buses[0] being the default bus) and keep the
+	// original static API available to the sketches.
 	static void setReadTimeouts(uint32_t start_response_timeout=LSS_Timeout, uint32_t msg_char_timeout=LSS_Timeout);
 	static int timedRead(void);
-	bool charToInt(char * inputstr, int32_t * intnum);
 	//static void initBus(Stream &, uint32_t);
 #ifdef LSS_SupportSoftwareSerial
 	static void initBus(SoftwareSerial & s, uint32_t baud);
 #endif
 	static void initBus(HardwareSerial & s, uint32_t baud);
+	static void initBus(HardwareSerial & s, uint32_t baud, uint8_t busNum);
+	static void attachBus(Stream & s, uint8_t busNum = 0);
+	static void mapIDGroup(uint8_t group, uint8_t busNum);
+	static LSSBus & getBus(uint8_t busNum = 0);
+	static LSSBus & getBusForID(uint8_t id);
 	static void closeBus(void);
+	static void pollBuses(void);
+	static void setShadowTTL(LSS_ShadowField field, uint16_t ttl);
+	static void invalidateShadow(uint8_t id = LSS_BroadcastID);
+	static bool getStats(uint8_t id, LSS_BusStats & stats);
+	static void printStats(Print & out, uint8_t id);
+	static void dumpStats(Print & out);
+	static void resetStats(void);
 	static bool genericWrite(uint8_t id, const char * cmd);
 	static bool genericWrite(uint8_t id, const char * cmd, int16_t value);
 	static bool genericWrite(uint8_t id, const char * cmd, int16_t value, const char * parameter, int16_t parameter_value);
+	static bool genericRead(uint8_t id, const char * cmd, LSS_QueryResult & result, char * text = nullptr, uint8_t text_size = 0);
+	// Former blocking reads, kept for existing sketches (the text is only valid until the next call)
 	static int16_t genericRead_Blocking_s16(uint8_t id, const char * cmd);
 	static char * genericRead_Blocking_str(uint8_t id, const char * cmd);
 
@@ -261,12 +516,14 @@ public:
 	//> Constructors/destructor
 	LSS();
 	LSS (uint8_t);
+	LSS (uint8_t id, LSSBus & bus);
 	~LSS(void);
 
 	//> Get/set for private attributes
 	uint8_t getServoID(void);
 	void setServoID(uint8_t);
 	LSS_LastCommStatus getLastCommStatus(void);
+	LSSBus & getServoBus(void);
 
 	//> Actions
 	bool reset(void);
@@ -284,20 +541,21 @@ public:
 	// uint8_t getID(void);
 	// uint8_t getBaud(void);
 	LSS_Status getStatus(void);
-	int16_t getOriginOffset(LSS_QueryType queryType = LSS_QuerySession);
-	uint16_t getAngularRange(LSS_QueryType queryType = LSS_QuerySession);
+	int16_t getOriginOffset(LSS_QueryType queryType = LSS_QuerySession, bool refresh = false);
+	uint16_t getAngularRange(LSS_QueryType queryType = LSS_QuerySession, bool refresh = false);
 	uint16_t getPositionPulse(void);
 	int32_t getPosition(void);
 	int16_t getSpeed(void);
 	int8_t getSpeedRPM(void);
 	int8_t getSpeedPulse(void);
-	uint16_t getMaxSpeed(LSS_QueryType queryType = LSS_QuerySession);
+	uint16_t getMaxSpeed(LSS_QueryType queryType = LSS_QuerySession, bool refresh = false);
 	int8_t getMaxSpeedRPM(LSS_QueryType queryType = LSS_QuerySession);
-	LSS_LED_Color getColorLED(LSS_QueryType queryType = LSS_QuerySession);
-	LSS_ConfigGyre getGyre(LSS_QueryType queryType = LSS_QuerySession);
+	LSS_LED_Color getColorLED(LSS_QueryType queryType = LSS_QuerySession, bool refresh = false);
+	LSS_ConfigGyre getGyre(LSS_QueryType queryType = LSS_QuerySession, bool refresh = false);
 	int16_t getFirstPosition(void);
 	bool getIsFirstPositionEnabled(void);
 	LSS_Model getModel(void);
+	bool getSerialNumber(char * serial, uint8_t size);
 	char * getSerialNumber(void);
 	uint16_t getFirmwareVersion(void);
 	uint16_t getVoltage(void);
@@ -306,13 +564,21 @@ public:
 	uint16_t getAnalog(void);
 	uint16_t getDistance_mm(LSS_QueryTypeDistance queryTypeDistance);
 
+	//> Queries (non-blocking, see LSSBus::request)
+	int8_t request(const char * cmd, LSS_QueryCallback callback = nullptr, uint16_t deadline = LSS_QueryDeadline);
+	int8_t requestStatus(LSS_QueryCallback callback = nullptr);
+	int8_t requestPosition(LSS_QueryCallback callback = nullptr);
+	int8_t requestVoltage(LSS_QueryCallback callback = nullptr);
+	int8_t requestTemperature(LSS_QueryCallback callback = nullptr);
+	int8_t requestCurrent(LSS_QueryCallback callback = nullptr);
+
 	//> Queries (advanced)
-	int8_t getAngularStiffness(LSS_QueryType queryType = LSS_QuerySession);
-	int8_t getAngularHoldingStiffness(LSS_QueryType queryType = LSS_QuerySession);
-	int16_t getAngularAcceleration(LSS_QueryType queryType = LSS_QuerySession);
-	int16_t getAngularDeceleration(LSS_QueryType queryType = LSS_QuerySession);
-	bool getIsMotionControlEnabled(void);
-	int16_t getFilterPositionCount(LSS_QueryType queryType = LSS_QuerySession);
+	int8_t getAngularStiffness(LSS_QueryType queryType = LSS_QuerySession, bool refresh = false);
+	int8_t getAngularHoldingStiffness(LSS_QueryType queryType = LSS_QuerySession, bool refresh = false);
+	int16_t getAngularAcceleration(LSS_QueryType queryType = LSS_QuerySession, bool refresh = false);
+	int16_t getAngularDeceleration(LSS_QueryType queryType = LSS_QuerySession, bool refresh = false);
+	bool getIsMotionControlEnabled(bool refresh = false);
+	int16_t getFilterPositionCount(LSS_QueryType queryType = LSS_QuerySession, bool refresh = false);
 	uint8_t getBlinkingLED(void);
 
 	//> Configs
@@ -341,16 +607,27 @@ private:
 	// Private functions - Class
 
 	// Private attributes - Class
-	static bool hardwareSerial;
-	static Stream * bus;
-	static LSS_LastCommStatus lastCommStatus;
-	static volatile unsigned int readID;
-	static char value[24];
-	static uint32_t _msg_char_timeout;   // timeout waiting for characters inside of packet
+	static LSSBus buses[LSS_MaxBuses];
+	static uint8_t idGroupBus[LSS_IDGroups];
+#ifdef LSS_SupportShadowCache
+	static LSS_ShadowEntry shadow[LSS_ShadowEntries];
+	static uint16_t shadowTTL[LSS_ShadowFields];
+#endif
+
 	// Private functions - Instance
+	bool write(const char * cmd);
+	bool write(const char * cmd, int16_t value);
+	bool write(const char * cmd, int16_t value, const char * parameter, int16_t parameter_value);
+	bool read(const char * cmd, LSS_QueryResult & result, char * text = nullptr, uint8_t text_size = 0);
+	int16_t read_s16(const char * cmd);
+	bool shadowRead(LSS_ShadowField field, LSS_QueryType queryType, bool refresh, int16_t & value);
+	void shadowStore(LSS_ShadowField field, LSS_QueryType queryType, int16_t value);
+	bool shadowWrite(LSS_ShadowField field, LSS_SetType setType, bool written, int16_t value);
+	static void shadowForget(uint8_t id);
 
 	// Private attributes - Instance
 	uint8_t servoID = LSS_ID_Default;
+	LSSBus * bus;		// nullptr: routed by ID through the library buses
 };
 
 #endif
@@ -11,6 +11,7 @@
  */
 
 #include "LSS_MCU.h"
+#include "Utils.h"
 
 // -- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
 // Class attributes instantiation   ---- ---- ---- ---- ---- ---- ---- ---- ----
@@ -19,12 +20,18 @@ bool MCU::hardwareSerial;
 Stream * MCU::bus;
 MCU_LastCommStatus MCU::lastCommStatus = MCU_CommStatus_Idle;
 uint32_t MCU::_msg_char_timeout = MCU_Timeout;
+MCU_Parser MCU::parser;
+#ifdef MCU_SupportBinary
+MCU_Setpoint MCU::setpoint;
+#endif
+#ifdef MCU_SupportBridge
+bool MCU::bridge = false;
+MCU_BridgeEntry MCU::bridgeQueue[MCU_BridgeQueue];
+uint8_t MCU::bridgeHead = 0;
+uint8_t MCU::bridgeCount = 0;
+#endif
 
 //> Command reading/writing
-volatile unsigned int MCU::readID;  // sscanf - assumes this
-volatile unsigned int MCU::readVal;
-char MCU::value[4];
-char MCU::cmd[4];
 uint8_t MCU::mcuID;
 // -- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
 // Constructor  ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
@@ -68,108 +75,6 @@ int MCU::timedRead(void)
 	return (-1);     // -1 indicates timeout
 }
 
-bool MCU::charToInt(char * inputstr, int32_t * intnum)
-{
-	uint8_t neg = 0, i = 0, j = 0;  //, res = 0;
-	int32_t val = 0;
-	bool err;
-
-	if (!inputstr) return true;
-
-	if (inputstr[0] == '0' && (inputstr[1] == 'x' || inputstr[1] == 'X'))
-	{
-		if (inputstr[2] == '\0') //"0x" only
-		{
-			val = 0;
-			*intnum = 0;
-			err = false;
-		}
-		else
-		{
-			for (i = 2; i < 11; i++)
-			{
-				if (inputstr[i] == '\0')
-				{
-					*intnum = val;
-					break;
-				}
-				if (ISVALIDHEX(inputstr[i]))
-				{
-					val = (val << 4) + CONVERTHEX(inputstr[i]);
-					err = true;
-				}
-				else
-				{
-					err = false;
-					break;
-				}
-			}
-		}
-		/* over 8 digit hex --invalid */
-		if (i >= 11)
-		{
-			err = false;
-		}
-	}
-	else /* max 10-digit decimal input */
-	{
-		if (inputstr[i] == '-')
-		{
-			// Indicate a negative int32_t
-			neg = 1;
-
-			// Skip the first character
-			j = 1;
-		}
-		for (i = j; i < 11; i++)
-		{
-			if (inputstr[i] == '\0')
-			{
-				if (neg)
-				{
-					if (i == j)
-					{
-						err = false;
-					}
-					else
-					{
-						val = -val;
-					}
-				}
-				else
-				{
-					if (i == 0)
-					{
-						err = false;
-					}
-				}
-
-				*intnum = val;
-
-				break;
-			}
-			else if (ISVALIDDEC(inputstr[i]))
-			{
-				val = val * 10 + CONVERTDEC(inputstr[i]);
-				err = true;
-			}
-			else
-			{
-				err = false;
-				break;
-			}
-		}
-		/* Over 10 digit decimal --invalid */
-		if (i >= 11)
-		{
-			err = false;
-		}
-	}
-
-	// Success
-	return (err);
-}
-
 #ifdef MCU_SupportSoftwareSerial
 // Initialize bus using a software serial
 void MCU::initBus(SoftwareSerial &s, uint32_t baud)
@@ -287,12 +192,95 @@ bool MCU::genericWrite(uint8_t id, const char * cmd, int16_t value, const char *
 	lastCommStatus = MCU_CommStatus_WriteSuccess;
 	return (true);
 }
+// Write a binary frame (see MCU_BinarySync) only if it fits whole in the transmit buffer: never
+// waits, the frame is dropped instead (WriteBusy). Streams that do not report their free space
+// (availableForWrite) cannot send frames, see canWriteBinary.
+bool MCU::writeBinary(uint8_t command, const uint8_t * fields, uint8_t length)
+{
+#ifdef MCU_SupportBinary
+	// Exit condition
+	if (bus == (Stream*) nullptr)
+	{
+		lastCommStatus = MCU_CommStatus_WriteNoBus;
+		return (false);
+	}
+	if (length > 254 || bus->availableForWrite() < length + 5)
+	{
+		lastCommStatus = MCU_CommStatus_WriteBusy;
+		return (false);
+	}
+
+	uint8_t header[3] = {MCU_BinarySync, (uint8_t) (length + 1), command};
+	uint16_t crc = crc16(header + 1, 2);
+	crc = crc16(fields, length, crc);
+	bus->write(header, 3);
+	bus->write(fields, length);
+	bus->write((uint8_t) (crc & 0xFF));
+	bus->write((uint8_t) (crc >> 8));
+	// Success
+	lastCommStatus = MCU_CommStatus_WriteSuccess;
+	return (true);
+#else
+	lastCommStatus = MCU_CommStatus_WriteUnknown;
+	return (false);
+#endif
+}
+
+// True if writeBinary can send frames on the bus. Only a hardware serial reports the free space of its
+// transmit buffer: SoftwareSerial always reports none, and its writes block with the interrupts off,
+// losing the commands received meanwhile.
+bool MCU::canWriteBinary(void)
+{
+#ifdef MCU_SupportBinary
+	return (bus != (Stream*) nullptr && hardwareSerial);
+#else
+	return (false);
+#endif
+}
+
+// Timing of a command sent with a tag (E<tag>), micros() when it was
+//	received: decoded from the bus
+//	applied: picked up by the gait
+//	transmitted: the first joint frame computed with it was written to the servo bus (0: no frame)
+//	-> *<mcuID>ECH<tag>,<received>,<applied>,<transmitted>\r
+void MCU::writeEcho(int16_t tag, uint32_t received, uint32_t applied, uint32_t transmitted)
+{
+	// Exit condition
+	if (bus == (Stream*) nullptr)
+	{
+		lastCommStatus = MCU_CommStatus_WriteNoBus;
+		return;
+	}
+
+	bus->write(MCU_CommandReplyStart);
+	bus->print(mcuID, DEC);
+	bus->write(MCU_EchoReply);
+	bus->print(tag, DEC);
+	bus->write(',');
+	bus->print(received, DEC);
+	bus->write(',');
+	bus->print(applied, DEC);
+	bus->write(',');
+	bus->print(transmitted, DEC);
+	bus->write(MCU_CommandEnd);
+	lastCommStatus = MCU_CommStatus_WriteSuccess;
+}
+
 //==============================================================================
-void MCU::genericRead(int16_t * CMD)
+// Commands are decoded one byte at a time as they arrive: a partial command stays in the parser
+// until its CR, and a new # always restarts it (resync after garbage).
+//	#<id><command letters>[<value>][V<value>][S<value>][E<value>]\r
+// Binary frames (MCU_BinarySync) are recognized on the same bus; inside one, # is data.
+
+// Decode the next complete command from the bytes already received; never waits.
+// Status is Idle when no complete command is available yet.
+void MCU::genericRead(MCU_Command & command)
 {
-	CMD[0] = NULL;	//Register
-	CMD[1] = NULL;	//Value
-	CMD[2] = NULL;	//Modifier
+	command.id = 0;
+	command.reg = 0;	//Register
+	command.value = 0;	//Value
+	command.speed = 0;	//Modifier
+	command.tag = -1;
 
 	// Exit condition
 	if (bus == (Stream*) nullptr)
@@ -301,286 +289,606 @@ void MCU::genericRead(int16_t * CMD)
 		return;
 	}
 
-	if (bus->available() > 0){
-		// Read from bus until first character; exit if not found before timeout
-		if (!(bus->find(MCU_CommandStart)))
+	while (bus->available() > 0)
+	{
+		int c = bus->read();
+		if (c < 0)
+			break;
+		if (MCU::feed((char) c))
 		{
-			lastCommStatus = MCU_CommStatus_ReadTimeout;
+			MCU::dispatch(command);
 			return;
 		}
+	}
+	lastCommStatus = MCU_CommStatus_Idle;
+}
 
-		// Ok we have the # now lets get the ID from the message
-		readID = 0;
-		int c;
-		bool valid_field = false;
-		while ((c = MCU::timedRead()) >= 0)
-		{
-			if ((c < '0') || (c > '9')) break;	// not a number character
-			readID = readID * 10 + c - '0';
-			valid_field = true;
-		}
-		if ((!valid_field))
-		{
-			lastCommStatus = MCU_CommStatus_ReadWrongID;
-			return;
-		}
-		else if (readID < MCU_ID_Min || readID == BroadcastID){	// Command for LSS servo
-			MCU::lssRead(readID,c);
-		}
-		else if (readID == mcuID){	// Command for the MCU
-			//Validate the right CMD
-			if (c == 'M'){
-				MCU::motionRead(CMD);
-			}
-			else{
-				lastCommStatus = MCU_CommStatus_ReadWrongIdentifier;
-				return;
-			}
-		}
-		else{
-			lastCommStatus = MCU_CommStatus_ReadWrongIdentifier;
-			return;
-		}
+static void MCU_numberStart(MCU_Parser & p, int8_t field)
+{
+	p.field = field;
+	p.number = 0;
+	p.digits = 0;
+	p.negative = false;
+}
 
-		//NOT IMPLEMENTED
-		// // If not a motion command check if valid
-		// size_t maxLength = 5;
-		// size_t index = 0;
-		// while (index < maxLength)
-		// {
-		// 	if (c < 0 || c == MCU_CommandEnd[0])
-		// 		break;
-		// 	value[index] = (char) c;
-		// 	index++;
-		// 	c = MCU::timedRead();
-		// }
-		// // value[index] = '\0';
-		// if (value != "RESET" || value != "CRC" || value != "QID" || value != "CID" || value != "QB" || value != "CB" || value != "Q" )
-		// {
-		// 	lastCommStatus = MCU_CommStatus_ReadWrongIdentifier;
-		// 	return;
-		// }
-		// else if (value == "CID" || value == "CB"){
-		// 	bool valid_value = false;
-		// 	readVal = 0;
-		// 	uint16_t configVal = 0;
-		// 	while ((c = MCU::timedRead()) >= 0)
-		// 	{
-		// 		if ((c < '0') || (c > '9')) break;	// not a number character
-		// 		readVal = readVal * 10 + c - '0';
-		// 		valid_value = true;
-		// 	}
-		// 	if ((!valid_value))
-		// 	{
-		// 		lastCommStatus = MCU_CommStatus_ReadWrongFormat;
-		// 		return;
-		// 	}
-		// 	else configVal = readVal;
-		// 	// Return value (success)
-		// 	lastCommStatus = MCU_CommStatus_ReadSuccess;
-		// }
-		// else if (value == "RESET" || value == "CRC" || value == "QID" || value == "QB" || value == "Q" )
-		// {
-		// 	//Do something
-		// }
+static void MCU_numberEnd(MCU_Parser & p)
+{
+	if (p.field < 0)
+		return;
+	if (p.digits == 0 || p.digits > 5 || p.number > 32767)
+	{
+		if (p.field != 2)		// a malformed speed only leaves the speed unchanged
+			p.error = MCU_CommStatus_ReadWrongFormat;
 	}
 	else
 	{
-		lastCommStatus = MCU_CommStatus_Idle;
+		p.fields[p.field] = p.negative ? -p.number : p.number;
+		p.given |= 1 << p.field;
 	}
+	p.field = -1;
 }
 
-void MCU::lssRead(uint8_t id, int c)
+// Feed one received character; true when a command is complete (CR)
+bool MCU::feed(char c)
 {
-	// Exit condition
-	if (bus == (Stream*) nullptr)
+	MCU_Parser & p = parser;
+#ifdef MCU_SupportBinary
+	if (p.state >= MCU_ParseBinaryLength)
+		return (MCU::feedBinary((uint8_t) c));
+	if ((uint8_t) c == MCU_BinarySync)
 	{
-		lastCommStatus = MCU_CommStatus_ReadNoBus;
-		return;
+		p.state = MCU_ParseBinaryLength;
+		return (false);
+	}
+#endif
+	if (c == MCU_CommandStart[0])
+	{
+		p.state = MCU_ParseID;
+		p.id = 0;
+		p.digits = 0;
+		p.length = 0;
+		p.given = 0;
+		p.field = -1;
+		p.error = MCU_CommStatus_Idle;
+		return (false);
 	}
 
-	if (bus->available() > 0){
-
-		// Check if valid command
-		size_t maxLength = 4;
-		size_t index = 0;
-
-		while (index < maxLength)
+	switch (p.state)
+	{
+		case (MCU_ParseID):
 		{
-			if ((c >= '0' && c <= '9') || c == MCU_CommandEnd[0]) break;
-			cmd[index] = (char) c;
-			index++;
-			c = MCU::timedRead();
+			if (IS_09(c) && p.digits < 3)
+			{
+				p.id = p.id * 10 + CONVERTDEC(c);
+				p.digits++;
+				break;
+			}
+			if (p.digits == 0 || p.id > MCU_Mode255ID)
+			{
+				p.error = MCU_CommStatus_ReadWrongID;
+				p.state = MCU_ParseSkip;
+				break;
+			}
+#ifdef MCU_SupportBridge
+			if (bridge && (p.id < MCU_ID_Min || p.id == BroadcastID))
+			{
+				p.state = MCU_ParseRaw;
+				return (MCU::feed(c));
+			}
+#endif
+			p.state = MCU_ParseCommand;
+			return (MCU::feed(c));		// c is the first command character
 		}
-		cmd[index] = '\0';
-		// Check if the command is not recognized
-		//	Position in Degrees			//	LED color				// LIMP				// HALT
-		if (strcmp(cmd, "D") != 0 && strcmp(cmd, "LED") != 0 && strcmp(cmd, "L") != 0 && strcmp(cmd, "H") != 0)
-		//if (false)
+		case (MCU_ParseCommand):
 		{
-			lastCommStatus = MCU_CommStatus_ReadWrongIdentifier;
-			return;
+			if (c == MCU_CommandEnd[0])
+			{
+				p.cmd[p.length] = '\0';
+				p.state = MCU_ParseWaitStart;
+				return (true);
+			}
+			if (c == '-' || IS_09(c))
+			{
+				p.cmd[p.length] = '\0';
+				p.state = MCU_ParseValue;
+				MCU_numberStart(p, 0);
+				return (MCU::feed(c));		// c is the first character of the value
+			}
+			if (p.length < MCU_MaxCommandLength)
+				p.cmd[p.length++] = c;
+			else
+			{
+				p.error = MCU_CommStatus_ReadWrongIdentifier;
+				p.state = MCU_ParseSkip;
+			}
+			break;
 		}
-		else
+		case (MCU_ParseValue):
 		{
-			//Get value
-			index = 0;
-			int16_t val;
-
-			while (index < maxLength)
+			if (c == MCU_CommandEnd[0])
 			{
-				if (c < 0 || c == MCU_CommandEnd[0]) break;
-				value[index] = (char) c;
-				index++;
-				c = MCU::timedRead();
+				MCU_numberEnd(p);
+				p.state = MCU_ParseWaitStart;
+				return (true);
 			}
-			value[index] = '\0';
-			if (c < 0)
+			if (c == '-' && p.digits == 0 && !p.negative && p.field >= 0)
+				p.negative = true;
+			else if (IS_09(c) && p.field >= 0)
 			{
-				// Did not get the ending CR
-				lastCommStatus = MCU_CommStatus_ReadTimeout;
+				if (p.digits < 5)
+					p.number = p.number * 10 + CONVERTDEC(c);
+				p.digits++;
 			}
+			else if (c == MCU_MotionValue[0] || c == MCU_MotionSpeed[0] || c == MCU_MotionEcho[0])
+			{
+				MCU_numberEnd(p);
+				MCU_numberStart(p, c == MCU_MotionValue[0] ? 1 : (c == MCU_MotionSpeed[0] ? 2 : 3));
+			}
+			else if (p.field == 2)
+				p.field = -1;	// speed dropped, as if not given
 			else
+				p.error = MCU_CommStatus_ReadWrongFormat;
+			break;
+		}
+#ifdef MCU_SupportBridge
+		case (MCU_ParseRaw):
+		{
+			if (c == MCU_CommandEnd[0])
+			{
+				p.raw[p.length] = '\0';
+				p.state = MCU_ParseWaitStart;
+				return (true);
+			}
+			if (p.length < MCU_BridgeCommandLength)
+				p.raw[p.length++] = c;
+			else
+			{
+				p.error = MCU_CommStatus_ReadWrongFormat;
+				p.state = MCU_ParseSkip;
+			}
+			break;
+		}
+#endif
+		case (MCU_ParseSkip):
+		{
+			if (c == MCU_CommandEnd[0])
 			{
-				val = valueRead(value);
-				LSS::genericWrite(id,cmd,val);
+				p.state = MCU_ParseWaitStart;
+				return (true);	// reported by dispatch
 			}
-		}	
+			break;
+		}
+		default:
+			break;
 	}
-	else
+	return (false);
+}
+
+// Feed one byte of a binary frame; true when the frame is complete (checked by dispatch)
+bool MCU::feedBinary(uint8_t c)
+{
+#ifdef MCU_SupportBinary
+	MCU_Parser & p = parser;
+	switch (p.state)
 	{
-		lastCommStatus = MCU_CommStatus_Idle;
+		case (MCU_ParseBinaryLength):
+		{
+			if (c == 0 || c > MCU_BinaryMaxPayload)
+			{
+				p.state = MCU_ParseWaitStart;	// not a frame: the length byte may start a new command
+				return (MCU::feed((char) c));
+			}
+			p.length = c;
+			p.index = 0;
+			p.binary = false;
+			p.crc = crc16(&c, 1);
+			p.state = MCU_ParseBinaryPayload;
+			break;
+		}
+		case (MCU_ParseBinaryPayload):
+		{
+			p.frame[p.index++] = c;
+			if (p.index == p.length)
+			{
+				p.crc = crc16(p.frame, p.length, p.crc);
+				p.index = 0;
+				p.state = MCU_ParseBinaryCRC;
+			}
+			break;
+		}
+		case (MCU_ParseBinaryCRC):
+		{
+			p.crc ^= (uint16_t) c << (p.index * 8);	// low byte first; 0 when it matches
+			if (++p.index == 2)
+			{
+				p.state = MCU_ParseWaitStart;
+				p.error = (p.crc == 0) ? MCU_CommStatus_Idle : MCU_CommStatus_ReadWrongChecksum;
+				p.binary = true;
+				return (true);
+			}
+			break;
+		}
+		default:
+			break;
 	}
+#endif
+	return (false);
 }
 
-void MCU::motionRead(int16_t * motionCMD)
+// Act on the command the parser completed
+void MCU::dispatch(MCU_Command & command)
 {
-	// Exit condition
-	if (bus == (Stream*) nullptr)
+	MCU_Parser & p = parser;
+#ifdef MCU_SupportBinary
+	if (p.binary)
 	{
-		lastCommStatus = MCU_CommStatus_ReadNoBus;
+		p.binary = false;
+		command.id = mcuID;
+		if (p.error != MCU_CommStatus_Idle)
+			lastCommStatus = p.error;
+		else
+			MCU::binaryCommand(command);
 		return;
 	}
+#endif
+	command.id = p.id;
+	if (p.error != MCU_CommStatus_Idle)
+	{
+		lastCommStatus = p.error;
+		return;
+	}
+	if (p.id < MCU_ID_Min || p.id == BroadcastID)	// Command for LSS servo
+	{
+#ifdef MCU_SupportBridge
+		if (bridge)
+		{
+			MCU::bridgeCommand();
+			return;
+		}
+#endif
+		MCU::lssCommand();
+	}
+	else if (p.id == mcuID)	// Command for the MCU
+	{
+		if (strcmp(p.cmd, "M") == 0)
+			MCU::motionCommand(command);
+		else
+			MCU::mcuCommand();
+	}
+	else
+		lastCommStatus = MCU_CommStatus_ReadWrongIdentifier;
+}
 
-	if (bus->available() > 0){
-		int c;
-		bool valid_field = 0;
+#ifdef MCU_SupportBinary
+// Little-endian field of a binary frame
+static int16_t MCU_int16(const uint8_t * f)
+{
+	return ((int16_t) (f[0] | (f[1] << 8)));
+}
+#endif
 
-		while ((c = MCU::timedRead()) >= 0)
+// Binary frame: the payload is in parser.frame, its CRC already checked
+void MCU::binaryCommand(MCU_Command & command)
+{
+#ifdef MCU_SupportBinary
+	MCU_Parser & p = parser;
+	const uint8_t * f = p.frame + 1;
+	switch (p.frame[0])
+	{
+		case (MCU_BinaryMotion):
 		{
-			if ((c < '0') || (c > '9')) break;	// not a number character
-			motionCMD[0] = motionCMD[0] * 10 + c - '0';
-			valid_field = true;
+			if ((p.length != 4 && p.length != 6 && p.length != 8) || f[0] >= MCU_Streaming)
+				break;
+			command.reg = f[0];
+			command.value = MCU_int16(f + 1);
+			if (p.length >= 6)
+			{
+				command.speed = MCU_int16(f + 3);
+				if (command.speed < 0)
+					command.speed = 0;
+			}
+			if (p.length == 8)
+			{
+				command.tag = MCU_int16(f + 5);
+				if (command.tag < 0)
+					command.tag = -1;
+			}
+			lastCommStatus = MCU_CommStatus_ReadSuccess;
+			return;
 		}
-
-		if ((!valid_field) || (motionCMD[0] >= 20))
+		case (MCU_BinarySetpoint):
 		{
-			lastCommStatus = MCU_CommStatus_ReadUnknown;
+			if (p.length != MCU_SetpointLength)
+				break;
+			setpoint.sequence = (uint16_t) MCU_int16(f);
+			setpoint.walk = MCU_int16(f + 2);
+			setpoint.speed = f[4];
+			setpoint.rotation = (int8_t) f[5];
+			setpoint.roll = MCU_int16(f + 6);
+			setpoint.pitch = MCU_int16(f + 8);
+			setpoint.yaw = MCU_int16(f + 10);
+			setpoint.frontal = MCU_int16(f + 12);
+			setpoint.height = MCU_int16(f + 14);
+			setpoint.lateral = MCU_int16(f + 16);
+			command.reg = MCU_Streaming;
+			lastCommStatus = MCU_CommStatus_ReadSuccess;
+			return;
 		}
-	
-		// If it is a special move
-		else if (c == MCU_CommandEnd[0])
+		case (MCU_BinarySequence):
 		{
-			if (motionCMD[0] == 0) motionCMD[1] = NULL; //Stop
-			// Return value (success)
+			uint8_t steps = (p.length - 2) / MCU_SequenceStepLength;
+			if (p.length < 2 || steps == 0 || steps > MCU_SequenceFrameSteps || p.length != 2 + steps * MCU_SequenceStepLength)
+				break;
+			command.reg = MCU_SequenceData;		// steps left in the frame, see getSequenceSteps
 			lastCommStatus = MCU_CommStatus_ReadSuccess;
+			return;
 		}
-		//if it isn't a special move
-		else if (c == 'V')
+		case (MCU_BinaryBatch):
 		{
-			//Get value
-			size_t maxLength = 4;
-			size_t index = 0;
-
-			while (index < maxLength)
-			{
-				c = MCU::timedRead();
-				if (c < 0 || c == MCU_CommandEnd[0] || c == 'S')
-					break;
-				value[index] = (char) c;
-				index++;
-			}
-			value[index] = '\0';
-
-			if (c < 0) 
-			{
-				// did not get the ending CR
-				lastCommStatus = MCU_CommStatus_ReadTimeout;
-				motionCMD[1] = NULL;
-			}
-			else motionCMD[1] = valueRead(value);
-
-			bool valid_speed = false;
-			readVal = 0;
-			if (c == 'S')
-			{
-				while ((c = MCU::timedRead()) >= 0)
-				{
-					if ((c < '0') || (c > '9')) break;	// not a number character
-					readVal = readVal * 10 + c - '0';
-					valid_speed = true;
-				}
-			}
-			if ((!valid_speed))
+			uint8_t count = (p.length - 2) / MCU_BatchRegisterLength;
+			if (p.length < 2 || count == 0 || count > MCU_BatchMaxRegisters || p.length != 2 + count * MCU_BatchRegisterLength)
+				break;
+			bool valid = true;
+			for (uint8_t i = 0; i < count; i++)
 			{
-				lastCommStatus = MCU_CommStatus_ReadUnknown;
-				motionCMD[2] = NULL;
+				if (f[1 + i * MCU_BatchRegisterLength] > MCU_GaitType)
+					valid = false;
 			}
-			else motionCMD[2] = readVal;
-			// Return value (success)
+			if (!valid)
+				break;
+			command.reg = MCU_BatchData;		// registers left in the frame, see getBatch
 			lastCommStatus = MCU_CommStatus_ReadSuccess;
+			return;
 		}
-		else
+		default:
+			break;
+	}
+	lastCommStatus = MCU_CommStatus_ReadWrongFormat;
+#endif
+}
+
+// Last setpoint received; false if setpoints are not supported (MCU_SupportBinary)
+bool MCU::getSetpoint(MCU_Setpoint & setpoint)
+{
+#ifdef MCU_SupportBinary
+	setpoint = MCU::setpoint;
+	return (true);
+#else
+	return (false);
+#endif
+}
+
+// Steps of the MCU_BinarySequence frame just read (valid until the next genericRead)
+bool MCU::getSequenceSteps(uint8_t & first, MCU_SequenceStep steps[MCU_SequenceFrameSteps], uint8_t & count)
+{
+#ifdef MCU_SupportBinary
+	MCU_Parser & p = parser;
+	if (p.frame[0] != MCU_BinarySequence || p.length < 2)
+		return (false);
+	first = p.frame[1];
+	count = (p.length - 2) / MCU_SequenceStepLength;
+	const uint8_t * f = p.frame + 2;
+	for (uint8_t i = 0; i < count; i++, f += MCU_SequenceStepLength)
+	{
+		steps[i].delay = (uint16_t) MCU_int16(f);
+		steps[i].reg = f[2];
+		steps[i].value = MCU_int16(f + 3);
+		steps[i].speed = f[5];
+	}
+	return (true);
+#else
+	return (false);
+#endif
+}
+
+// Registers of the MCU_BinaryBatch frame just read (valid until the next genericRead)
+bool MCU::getBatch(uint8_t & speed, MCU_Register registers[MCU_BatchMaxRegisters], uint8_t & count)
+{
+#ifdef MCU_SupportBinary
+	MCU_Parser & p = parser;
+	if (p.frame[0] != MCU_BinaryBatch || p.length < 2)
+		return (false);
+	speed = p.frame[1];
+	count = (p.length - 2) / MCU_BatchRegisterLength;
+	const uint8_t * f = p.frame + 2;
+	for (uint8_t i = 0; i < count; i++, f += MCU_BatchRegisterLength)
+	{
+		registers[i].reg = f[0];
+		registers[i].value = MCU_int16(f + 1);
+	}
+	return (true);
+#else
+	return (false);
+#endif
+}
+
+// Reply from the MCU itself: *<mcuID><cmd><value>\r
+void MCU::writeReply(const char * cmd, int32_t value)
+{
+	// Exit condition
+	if (bus == (Stream*) nullptr)
+	{
+		lastCommStatus = MCU_CommStatus_WriteNoBus;
+		return;
+	}
+
+	bus->write(MCU_CommandReplyStart);
+	bus->print(mcuID, DEC);
+	bus->write(cmd);
+	bus->print(value, DEC);
+	bus->write(MCU_CommandEnd);
+	lastCommStatus = MCU_CommStatus_WriteSuccess;
+}
+
+// Forward a servo command (D, LED, L or H) to the LSS bus
+void MCU::lssCommand(void)
+{
+	MCU_Parser & p = parser;
+	// Check if the command is not recognized
+	//	Position in Degrees			//	LED color				// LIMP				// HALT
+	if (strcmp(p.cmd, "D") != 0 && strcmp(p.cmd, "LED") != 0 && strcmp(p.cmd, "L") != 0 && strcmp(p.cmd, "H") != 0)
+	{
+		lastCommStatus = MCU_CommStatus_ReadWrongIdentifier;
+		return;
+	}
+	if (p.given & ~1)
+	{
+		lastCommStatus = MCU_CommStatus_ReadWrongFormat;	// V or S: not a servo command
+		return;
+	}
+	if (p.given & 1)
+		LSS::genericWrite(p.id, p.cmd, p.fields[0]);
+	else
+		LSS::genericWrite(p.id, p.cmd);
+	lastCommStatus = MCU_CommStatus_WriteSuccess;	// forwarded, nothing for the MCU itself
+}
+
+// Bridge mode: every servo command is queued as received (see serviceBridge); when off, only
+// D, LED, L and H are forwarded, at once
+void MCU::setBridge(bool enable)
+{
+#ifdef MCU_SupportBridge
+	bridge = enable;
+	bridgeCount = 0;
+#endif
+}
+
+// Queue the servo command the parser kept as text
+void MCU::bridgeCommand(void)
+{
+#ifdef MCU_SupportBridge
+	MCU_Parser & p = parser;
+	if (p.length == 0)
+	{
+		lastCommStatus = MCU_CommStatus_ReadWrongIdentifier;
+		return;
+	}
+	// The baud of the servos is not changed under the running bus (nothing would follow them)
+	uint8_t baud = strlen(LSS_ConfigBaud);
+	if (strncmp(p.raw, LSS_ConfigBaud, baud) == 0 && (p.raw[baud] == '\0' || IS_09(p.raw[baud])))
+	{
+		lastCommStatus = MCU_CommStatus_ReadWrongIdentifier;
+		return;
+	}
+	// Queries are tracked by the servo bus: the letters must fit a pending query, the servo replies
+	// with them alone, the query type (ex: QAS1, QFPC1) is sent apart
+	uint8_t letters = 0, queryType = LSS_QuerySession;
+	if (p.raw[0] == 'Q')
+	{
+		while (letters < p.length && p.raw[letters] >= 'A' && p.raw[letters] <= 'Z')
+			letters++;
+		if (letters < p.length)
+			queryType = IS_09(p.raw[letters]) ? CONVERTDEC(p.raw[letters]) : 0xFF;
+		if (letters > LSS_MaxQueryLength || p.length - letters > 1 || queryType > LSS_QueryTargetTravelSpeed)
 		{
-			lastCommStatus = MCU_CommStatus_ReadWrongIdentifier;
+			lastCommStatus = MCU_CommStatus_ReadWrongFormat;
 			return;
 		}
+		p.raw[letters] = '\0';
 	}
-	else
+	if (bridgeCount >= MCU_BridgeQueue)
 	{
-		lastCommStatus = MCU_CommStatus_Idle;
+		lastCommStatus = MCU_CommStatus_WriteBusy;	// dropped
+		return;
 	}
+	MCU_BridgeEntry & entry = bridgeQueue[(bridgeHead + bridgeCount) % MCU_BridgeQueue];
+	entry.id = p.id;
+	strcpy(entry.text, p.raw);
+	entry.queryType = queryType;
+	bridgeCount++;
+	lastCommStatus = MCU_CommStatus_WriteSuccess;	// queued, nothing for the MCU itself
+#endif
 }
 
-//==============================================================================
-int16_t MCU::valueRead(const char * valueStr)
+// Forward the oldest queued servo commands; call between gait frames. Never waits: a query is
+// sent as a non-blocking servo query (LSSBus::request) and its reply relayed by bridgeReply.
+void MCU::serviceBridge(void)
 {
-	// Let the string function do all of the main parsing work.
-	if (valueStr == (char *) nullptr)
+#ifdef MCU_SupportBridge
+	for (uint8_t n = 0; n < MCU_BridgePerTick && bridgeCount > 0; n++)
 	{
-		// the above method will have already set the error condition. 
-		return 0;
+		MCU_BridgeEntry & entry = bridgeQueue[bridgeHead];
+		if (entry.text[0] == 'Q')
+		{
+			LSSBus & servoBus = LSS::getBusForID(entry.id);
+			uint16_t deadline = servoBus.getReplyTimeout(entry.id) / 1000 + 1;
+			if (servoBus.request(entry.id, entry.text, (LSS_QueryType) entry.queryType, MCU::bridgeReply, deadline) < 0)
+				return;		// no free query slot: retried on the next call
+		}
+		else
+		{
+			LSS::genericWrite(entry.id, entry.text);
+			LSS::invalidateShadow(entry.id);	// the cached getters ask the servo again (broadcast: all of them)
+		}
+		bridgeHead = (bridgeHead + 1) % MCU_BridgeQueue;
+		bridgeCount--;
 	}
+#endif
+}
 
-	// Exit condition
+// Reply of a bridged query, relayed to the controller as the servo sent it (text values too, ex: QMS, QN).
+// A query without a valid reply is answered too, ex: *5QDERR2\r on timeout (see MCU_BridgeError).
+void MCU::bridgeReply(const LSS_QueryResult & result)
+{
 	if (bus == (Stream*) nullptr)
+		return;
+	bus->write(MCU_CommandReplyStart);
+	bus->print(result.id, DEC);
+	bus->write(result.cmd);
+	if (result.status == LSS_CommStatus_ReadSuccess || result.status == LSS_CommStatus_ReadWrongFormat)
+		bus->write(LSS::getBusForID(result.id).getReplyText());
+	else
 	{
-		lastCommStatus = MCU_CommStatus_ReadNoBus;
-		return (0);
+		bus->write(MCU_BridgeError);
+		bus->print((int) result.status, DEC);
 	}
+	bus->write(MCU_CommandEnd);
+}
 
-	// convert the value string to value
-	int16_t value = 0;
-	int16_t value_sign = 1;
-	for(;;)
+// Query or action for the MCU itself
+//	QBS[<id>]\r	-> *<mcuID>QBS<servo bus counters>\r (no ID: whole bus, see LSS::printStats)
+//	RBS\r		-> servo bus counters cleared
+void MCU::mcuCommand(void)
+{
+	MCU_Parser & p = parser;
+	int16_t id = (p.given & 1) ? p.fields[0] : LSS_BroadcastID;
+	if (strcmp(p.cmd, MCU_QueryBusStats) == 0 && id >= LSS_ID_Min && id <= LSS_BroadcastID)
 	{
-		if ((*valueStr >= '0') && (*valueStr <= '9'))
-			value = value * 10 + *valueStr - '0';
-		else if (*valueStr == '-')
-			value_sign = -1;
-		else 
-			break;
-		valueStr++; 
+		bus->write(MCU_CommandReplyStart);
+		bus->print(mcuID, DEC);
+		bus->write(MCU_QueryBusStats);
+		LSS::printStats(*bus, id);
+		bus->write(MCU_CommandEnd);
 	}
-	// now see if we exited with valid number
-	if (*valueStr != '\0')
+	else if (strcmp(p.cmd, MCU_ActionResetBusStats) == 0)
+		LSS::resetStats();
+	else
 	{
-		lastCommStatus = MCU_CommStatus_ReadWrongID;
-		return (0);
+		lastCommStatus = MCU_CommStatus_ReadWrongIdentifier;
+		return;
 	}
-	// return the computed value
-	return value * value_sign; 
-} 
+	lastCommStatus = MCU_CommStatus_WriteSuccess;	// answered, nothing for the motion
+}
+
+// Motion command: M<register>[V<value>[S<speed>]][E<tag>]\r
+void MCU::motionCommand(MCU_Command & command)
+{
+	MCU_Parser & p = parser;
+	if (!(p.given & 1) || p.fields[0] < 0 || p.fields[0] >= MCU_Streaming)
+	{
+		lastCommStatus = MCU_CommStatus_ReadUnknown;
+		return;
+	}
+	command.reg = p.fields[0];
+	// No value: special move or stop
+	command.value = (p.given & 2) ? p.fields[1] : 0;
+	// Speed is optional (0 = unchanged)
+	command.speed = ((p.given & 4) && p.fields[2] > 0) ? p.fields[2] : 0;
+	// Timing echo requested
+	command.tag = ((p.given & 8) && p.fields[3] >= 0) ? p.fields[3] : -1;
+	// Return value (success)
+	lastCommStatus = MCU_CommStatus_ReadSuccess;
+}
 
 
 // -- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
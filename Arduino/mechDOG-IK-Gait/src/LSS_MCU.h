@@ -23,6 +23,14 @@
 // If you want to use RC control you will need to comment the line below.
 //#undef MCU_SupportPPM
 
+#define MCU_SupportBinary
+// Uncomment the line below to disable the binary frames (see MCU_BinarySync). ASCII commands are always accepted.
+//#undef MCU_SupportBinary
+
+#define MCU_SupportBridge
+// Uncomment the line below to remove the servo bridge (see MCU::setBridge), freeing some RAM.
+//#undef MCU_SupportBridge
+
 // Ensure compatibility
 #if (ARDUINO >= 100)
 #include "Arduino.h"
@@ -59,6 +67,20 @@
 #define MCU_CommandStart			("#")
 #define MCU_CommandReplyStart		("*")
 #define MCU_CommandEnd				("\r")
+#define MCU_MaxLSSCommandLength		(3)		// ex: LED
+#define MCU_MaxCommandLength		(3)		// ex: QBS, commands for the MCU itself
+
+//> Binary frames, told apart from ASCII by the sync byte (never part of an ASCII command):
+//	<sync> <length> <command> <fields, little-endian> <CRC-16 low> <CRC-16 high>
+//	length counts the command byte and the fields; the CRC (CRC-16/CCITT-FALSE, see crc16) covers length to the last field
+#define MCU_BinarySync				(0xA5)
+#define MCU_BinaryMaxPayload		(20)	// command byte + fields
+
+//> Servo bridge: any command for a servo ID is queued and forwarded between gait frames
+#define MCU_BridgeCommandLength		(12)	// after the ID, ex: D-1800T10000
+#define MCU_BridgeQueue				(4)		// commands waiting to be forwarded
+#define MCU_BridgePerTick			(1)		// commands forwarded per MCU::serviceBridge call
+#define MCU_BridgeError				("ERR")	// bridged query without a reply: *<id><cmd>ERR<LSS_LastCommStatus>\r
 
 //> MCU constants
 #define MCU_ID_Default				(100)
@@ -79,7 +101,9 @@ enum MCU_LastCommStatus
 	MCU_CommStatus_ReadUnknown,
 	MCU_CommStatus_WriteSuccess,
 	MCU_CommStatus_WriteNoBus,
-	MCU_CommStatus_WriteUnknown
+	MCU_CommStatus_WriteUnknown,
+	MCU_CommStatus_ReadWrongChecksum,
+	MCU_CommStatus_WriteBusy
 };
 
 enum MCU_Status
@@ -136,6 +160,7 @@ enum MCU_ConfigMode
 
 //> Commands - actions
 #define MCU_ActionReset				("RESET")
+#define MCU_ActionResetBusStats		("RBS")
 
 //> Commands - queries
 #define MCU_QueryStatus				("Q")
@@ -144,6 +169,7 @@ enum MCU_ConfigMode
 #define MCU_QueryBaud				("QB")
 #define MCU_QueryModelString		("QMS")
 #define MCU_QueryAnalog				("QA")
+#define MCU_QueryBusStats			("QBS")		// servo bus counters, see LSS::printStats
 
 //> Commands - configurations
 #define MCU_ConfigID						("CID")
@@ -156,6 +182,9 @@ enum MCU_ConfigMode
 
 //>Commands - motion values
 #define MCU_MotionValue 					("V")
+#define MCU_MotionSpeed 					("S")
+#define MCU_MotionEcho 						("E")		// tag: the timing of the command is echoed (see MCU::writeEcho)
+#define MCU_EchoReply						("ECH")
 
 enum Motion_commands{
 	//>Commands -  motions
@@ -178,7 +207,119 @@ enum Motion_commands{
 	MCU_Stretch,
 	MCU_Sequence,
 	MCU_Jog_On,
-	MCU_Jog_Off
+	MCU_Jog_Off,
+	//>Binary only: a full body setpoint was received (see MCU::getSetpoint)
+	MCU_Streaming,
+	//>Binary only: sequence steps were received (see MCU::getSequenceSteps)
+	MCU_SequenceData,
+	//>Binary only: several registers to apply together were received (see MCU::getBatch)
+	MCU_BatchData
+};
+
+//>Binary commands (first payload byte)
+enum MCU_BinaryCommands
+{
+	MCU_BinaryMotion = 1,		// register (u8), value (i16), [speed (i16), [tag (i16)]]: same as M<register>V<value>S<speed>E<tag>
+	MCU_BinarySetpoint = 2,		// MCU_Setpoint, fields in declaration order
+	MCU_BinarySequence = 3,		// index of the first step (u8, 0 starts a new sequence), 1 to 3 MCU_SequenceStep
+	MCU_BinaryBatch = 4,		// speed (u8, 0: unchanged), 1 to 6 times register (u8, MCU_Walking to MCU_GaitType) + value (i16)
+	//>Sent by the robot
+	MCU_BinaryTelemetry = 0x80	// see Quadruped::sendTelemetry
+};
+
+// Full body setpoint, streamed by the host every frame (MCU_BinarySetpoint)
+struct MCU_Setpoint
+{
+	uint16_t sequence;		// incremented by the host for every frame
+	int16_t walk;			// walk direction (degrees, 0: stop), as M0
+	uint8_t speed;			// 1 to 4, 0: unchanged
+	int8_t rotation;		// -1: CCW, 0: stop, 1: CW
+	int16_t roll;			// degrees
+	int16_t pitch;
+	int16_t yaw;
+	int16_t frontal;		// mm, cg offsets
+	int16_t height;
+	int16_t lateral;
+};
+#define MCU_SetpointLength			(19)	// payload of a MCU_BinarySetpoint frame
+
+// Step of a motion sequence uploaded to the robot (MCU_BinarySequence, played with M17)
+struct MCU_SequenceStep
+{
+	uint16_t delay;			// ms after the previous step (after the start for the first one)
+	uint8_t reg;			// motion register (Motion_commands), no MCU_Sequence
+	int16_t value;
+	uint8_t speed;			// 1 to 4, 0: unchanged
+};
+#define MCU_SequenceStepLength		(6)		// bytes of a step in a MCU_BinarySequence frame
+#define MCU_SequenceFrameSteps		(3)		// steps per MCU_BinarySequence frame, at most
+#define MCU_SequenceReply			("SEQ")	// *<mcuID>SEQ<steps stored>\r after each MCU_BinarySequence frame
+
+// Register of a batch, all applied in the same tick (MCU_BinaryBatch)
+struct MCU_Register
+{
+	uint8_t reg;			// MCU_Walking to MCU_GaitType
+	int16_t value;
+};
+#define MCU_BatchRegisterLength		(3)		// bytes of a register in a MCU_BinaryBatch frame
+#define MCU_BatchMaxRegisters		(6)		// registers per MCU_BinaryBatch frame, at most
+
+// A command decoded from the bus (see MCU::genericRead)
+struct MCU_Command
+{
+	uint8_t id;
+	int16_t reg;			// motion register (Motion_commands)
+	int16_t value;			// V, 0 if not given
+	int16_t speed;			// S, 0 if not given
+	int16_t tag;			// E, -1 if not given
+};
+
+enum MCU_ParserState
+{
+	MCU_ParseWaitStart,
+	MCU_ParseID,
+	MCU_ParseCommand,
+	MCU_ParseValue,
+	MCU_ParseSkip,
+	MCU_ParseRaw,				// servo command kept as text for the bridge
+	MCU_ParseBinaryLength,
+	MCU_ParseBinaryPayload,
+	MCU_ParseBinaryCRC
+};
+
+#define MCU_Fields					(4)		// value after the command letters, after V, after S, after E
+
+// Command being received, kept across reads until its CR
+struct MCU_Parser
+{
+	MCU_ParserState state;
+	uint16_t id;
+	char cmd[MCU_MaxCommandLength + 1];
+	uint8_t length;
+	int8_t field;				// field being received, -1: none
+	int32_t number;
+	uint8_t digits;
+	bool negative;
+	int16_t fields[MCU_Fields];
+	uint8_t given;				// bit n: fields[n] received
+	MCU_LastCommStatus error;	// first error in the command, Idle: none
+#ifdef MCU_SupportBridge
+	char raw[MCU_BridgeCommandLength + 1];
+#endif
+#ifdef MCU_SupportBinary
+	bool binary;				// the command is a binary frame
+	uint8_t frame[MCU_BinaryMaxPayload];
+	uint8_t index;				// bytes of the binary frame received (payload then CRC)
+	uint16_t crc;
+#endif
+};
+
+// Servo command waiting in the bridge queue
+struct MCU_BridgeEntry
+{
+	uint8_t id;
+	char text[MCU_BridgeCommandLength + 1];	// command letters and values, without # ID and CR (query: letters only)
+	uint8_t queryType;						// query: LSS_QueryType sent after the letters (ex: QAS1)
 };
 
 // library interface description
@@ -188,7 +329,6 @@ public:
 	// Public functions - Class
 	static void setReadTimeouts(uint32_t start_response_timeout=MCU_Timeout, uint32_t msg_char_timeout=MCU_Timeout);
 	static int timedRead(void);
-	bool charToInt(char * inputstr, int32_t * intnum);
 #ifdef MCU_SupportSoftwareSerial
 	static void initBus(SoftwareSerial & s, uint32_t baud);
 #endif
@@ -197,10 +337,16 @@ public:
 	static bool genericWrite(uint8_t id, const char * cmd);
 	static bool genericWrite(uint8_t id, const char * cmd, int16_t value);
 	static bool genericWrite(uint8_t id, const char * cmd, int16_t value, const char * parameter, int16_t parameter_value);
-	static void genericRead(int16_t * myArray);
-	static int16_t valueRead(const char * value);
-	static void motionRead(int16_t * myArray);
-	static void lssRead(uint8_t id, int c);
+	static bool writeBinary(uint8_t command, const uint8_t * fields, uint8_t length);
+	static bool canWriteBinary(void);
+	static void writeEcho(int16_t tag, uint32_t received, uint32_t applied, uint32_t transmitted);
+	static void genericRead(MCU_Command & command);
+	static bool getSetpoint(MCU_Setpoint & setpoint);
+	static bool getSequenceSteps(uint8_t & first, MCU_SequenceStep steps[MCU_SequenceFrameSteps], uint8_t & count);
+	static bool getBatch(uint8_t & speed, MCU_Register registers[MCU_BatchMaxRegisters], uint8_t & count);
+	static void writeReply(const char * cmd, int32_t value);
+	static void setBridge(bool enable);
+	static void serviceBridge(void);
 
 	// Public attributes - Class
 
@@ -232,16 +378,31 @@ public:
 
 private:
 	// Private functions - Class
+	static bool feed(char c);
+	static void dispatch(MCU_Command & command);
+	static void lssCommand(void);
+	static void mcuCommand(void);
+	static void motionCommand(MCU_Command & command);
+	static bool feedBinary(uint8_t c);
+	static void bridgeCommand(void);
+	static void bridgeReply(const LSS_QueryResult & result);
+	static void binaryCommand(MCU_Command & command);
 
 	// Private attributes - Class
 	static bool hardwareSerial;
 	static Stream * bus;
 	static MCU_LastCommStatus lastCommStatus;
-	static volatile unsigned int readID;
-	static volatile unsigned int readVal;
-	static char value[4];
-	static char cmd[4];
 	static uint32_t _msg_char_timeout;   // timeout waiting for characters inside of packet
+	static MCU_Parser parser;
+#ifdef MCU_SupportBinary
+	static MCU_Setpoint setpoint;
+#endif
+#ifdef MCU_SupportBridge
+	static bool bridge;
+	static MCU_BridgeEntry bridgeQueue[MCU_BridgeQueue];
+	static uint8_t bridgeHead;
+	static uint8_t bridgeCount;
+#endif
 	// Private functions - Instance
 
 	// Private attributes - Instance
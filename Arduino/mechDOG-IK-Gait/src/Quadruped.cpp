@@ -10,36 +10,268 @@
  */
 
 #include "Quadruped.h"
+#ifdef QUADRUPED_SupportFastBoot
+#include <EEPROM.h>
+#endif
 
-Quadruped::Quadruped(LSS_Robot_Model robot_model = MechDog){
+Quadruped::Quadruped(LSS_Robot_Model robot_model){
     this->robot = Body(robot_model);
     this->changeSpeed(this->speed);
 }
 
 Quadruped::~Quadruped(void){}
 
-void Quadruped::initServoBus(HardwareSerial &s, uint32_t baud){
+// servo IDs of the robot, used to probe and verify the buses
+static const uint8_t servo_ids[12] = {11,12,13,21,22,23,31,32,33,41,42,43};
+static const int8_t servo_gyre[12] = {1,-1,-1, 1,-1,-1, -1,1,1, -1,1,1};
+
+#ifdef QUADRUPED_SupportFastBoot
+static const char * const config_queries[ConfigFields] = {LSS_QueryGyre, LSS_QueryAngularStiffness, LSS_QueryAngularHoldingStiffness, LSS_QueryFilterPositionCount, LSS_QueryEnableMotionControl};
+#endif
+
+void Quadruped::initServoBus(HardwareSerial &s, uint32_t baud, bool auto_baud){
+    this->boot_start = millis();
     LSS::initBus(s, baud);
+    if(auto_baud) this->upgradeServoBaud(baud);
+    this->configServos();
+}
+
+#if LSS_MaxBuses > 1
+// Front legs (2 & 4) on one UART and rear legs (1 & 3) on another, both buses are filled in parallel
+void Quadruped::initServoBus(HardwareSerial &front, HardwareSerial &rear, uint32_t baud, bool auto_baud){
+    this->boot_start = millis();
+    LSS::initBus(rear, baud, 0);
+    LSS::initBus(front, baud, 1);
+    LSS::mapIDGroup(1, 0);
+    LSS::mapIDGroup(2, 1);
+    LSS::mapIDGroup(3, 0);
+    LSS::mapIDGroup(4, 1);
+    if(auto_baud) this->upgradeServoBaud(baud);
+    this->configServos();
+}
+#endif
+
+// Probe the baud the servos answer at and move every bus to the fastest baud the MCU supports
+void Quadruped::upgradeServoBaud(uint32_t baud){
+    for (uint8_t b = 0; b < LSS_MaxBuses; b++){
+        LSSBus &bus = LSS::getBus(b);
+        if(!bus.isOpen()) continue;
+        uint8_t ids[12];
+        uint8_t count = 0;
+        for (uint8_t i = 0; i < 12; i++){
+            if(&LSS::getBusForID(servo_ids[i]) == &bus) ids[count++] = servo_ids[i];
+        }
+        bus.upgradeBaud(ids, count, baud);
+    }
+}
+
+// Highest rate at which a full 12 servo frame fits on the slowest bus (frames/s)
+uint16_t Quadruped::getMaxFrameRate(void){
+    uint16_t rate = 0;
+    for (uint8_t b = 0; b < LSS_MaxBuses; b++){
+        LSSBus &bus = LSS::getBus(b);
+        if(!bus.isOpen()) continue;
+        uint8_t count = 0;
+        for (uint8_t i = 0; i < 12; i++){
+            if(&LSS::getBusForID(servo_ids[i]) == &bus) count++;
+        }
+        if(count == 0) continue;
+        uint32_t bus_rate = bus.getBaud()/10/(count*LSS_MoveCommandLength);   // 10 bits per byte
+        if(rate == 0 || bus_rate < rate) rate = bus_rate;
+    }
+    return rate;
+}
+
+void Quadruped::configServos(void){
+#ifdef QUADRUPED_SupportFastBoot
+    if(this->fastBoot()) return;
+#endif
      //Settings
-    LSS(11).setGyre(1);
-    LSS(12).setGyre(-1);
-    LSS(13).setGyre(-1);
+    this->writeAllConfig(LSS_SetSession);
+    this->reconfigured = 12;
 
-    LSS(21).setGyre(1);
-    LSS(22).setGyre(-1);
-    LSS(23).setGyre(-1);
+    LSS(254).setMotionControlEnabled(this->output_mode == TimedOutput);
+}
 
-    LSS(31).setGyre(-1);
-    LSS(32).setGyre(1);
-    LSS(33).setGyre(1);
+// Settings every servo must have: gyre, stiffness, filter of the current speed and EM of the output mode
+void Quadruped::desiredConfig(uint8_t index, int16_t config[ConfigFields]){
+    config[ConfigGyre] = servo_gyre[index];
+    config[ConfigStiffness] = ServoStiffness;
+    config[ConfigHoldingStiffness] = ServoHoldingStiffness;
+    config[ConfigFilterCount] = this->filterCount(this->actual_speed);
+    config[ConfigMotionControl] = (this->output_mode == TimedOutput);
+}
 
-    LSS(41).setGyre(-1);
-    LSS(42).setGyre(1);
-    LSS(43).setGyre(1);
+void Quadruped::writeServoConfig(uint8_t index, LSS_SetType set_type){
+    int16_t config[ConfigFields];
+    this->desiredConfig(index, config);
+    LSS servo = LSS(servo_ids[index]);
+    servo.setGyre((LSS_ConfigGyre)config[ConfigGyre], set_type);
+    servo.setAngularHoldingStiffness(config[ConfigHoldingStiffness], set_type);
+    servo.setAngularStiffness(config[ConfigStiffness], set_type);
+    if(config[ConfigFilterCount] > 0) servo.setFilterPositionCount(config[ConfigFilterCount], set_type);
+}
 
-    LSS(254).setMotionControlEnabled(false);
-    LSS(254).setAngularHoldingStiffness(1);
-    LSS(254).setAngularStiffness(-2);
+// Gyre of each servo, the settings shared by all the servos are broadcast
+void Quadruped::writeAllConfig(LSS_SetType set_type){
+    int16_t config[ConfigFields];
+    for(uint8_t i = 0; i < 12; i++){
+        this->desiredConfig(i, config);
+        LSS(servo_ids[i]).setGyre((LSS_ConfigGyre)config[ConfigGyre], set_type);
+    }
+    LSS(254).setAngularHoldingStiffness(config[ConfigHoldingStiffness], set_type);
+    LSS(254).setAngularStiffness(config[ConfigStiffness], set_type);
+    if(config[ConfigFilterCount] > 0) LSS(254).setFilterPositionCount(config[ConfigFilterCount], set_type);
+}
+
+#ifdef QUADRUPED_SupportFastBoot
+// Warm boot: the settings are kept in the servos config (CG, CAS, CAH, CFPC) and the hash of that config in EEPROM.
+// While the hash matches, the stored settings are only read back and the servos that differ are rewritten;
+// the session values are set in every case.
+// Returns false if no servo answers or the EEPROM cannot be used (the blind configuration is used).
+bool Quadruped::fastBoot(void){
+    if(!this->waitServos()) return false;
+
+    uint16_t hash = this->configHash();
+    uint16_t stored = 0;
+#if defined(ARDUINO_ARCH_ESP32)
+    // The ESP32 EEPROM is emulated in flash and must be mapped first (a sketch using more of it begins it larger beforehand)
+    if(!EEPROM.begin(this->config_hash_address + sizeof(hash))) return false;
+#endif
+    EEPROM.get(this->config_hash_address, stored);
+
+    this->reconfigured = 0;
+    if(stored != hash){
+        // First boot with this config: store it in every servo
+        this->writeAllConfig(LSS_SetConfig);
+        this->writeAllConfig(LSS_SetSession);
+        this->reconfigured = 12;
+        LSS(254).setMotionControlEnabled(this->output_mode == TimedOutput);
+        EEPROM.put(this->config_hash_address, hash);
+#if defined(ARDUINO_ARCH_ESP32)
+        EEPROM.commit();
+#endif
+        return true;
+    }
+
+    int16_t config[12][ConfigFields];
+    bool answered[12];
+    this->readServoConfig(config, answered);
+
+    bool motion_control = false;
+    for(uint8_t i = 0; i < 12; i++){
+        int16_t desired[ConfigFields];
+        this->desiredConfig(i, desired);
+        bool differs = !answered[i];
+        for(uint8_t f = 0; f < ConfigMotionControl; f++){
+            if(config[i][f] != desired[f] && !(f == ConfigFilterCount && desired[f] <= 0)) differs = true;
+        }
+        if(!answered[i] || config[i][ConfigMotionControl] != desired[ConfigMotionControl]) motion_control = true;
+        if(differs){
+            this->writeServoConfig(i, LSS_SetConfig);
+            this->reconfigured++;
+        }
+    }
+    // The session values are not read back: after a reset of the MCU alone they are whatever the last
+    // run left (speed filter, derating), so they are always set (no flash write)
+    this->writeAllConfig(LSS_SetSession);
+    // EM is a session setting, one broadcast if any servo is not in the right mode
+    if(motion_control) LSS(254).setMotionControlEnabled(this->output_mode == TimedOutput);
+    return true;
+}
+
+// The servos take about a second to start after power-up: poll them instead of a fixed delay
+bool Quadruped::waitServos(void){
+    uint32_t start = millis();
+    LSS_QueryResult result;
+    do{
+        LSS::genericWrite(servo_ids[0], LSS_QueryStatus);
+        if(LSS::genericRead(servo_ids[0], LSS_QueryStatus, result)) return true;
+    }while(millis() - start < LSS_ResetTime);
+    return false;
+}
+
+// Read back the stored settings of the 12 servos (config plane, EM: session): one query in flight per bus, the next one is sent as soon
+// as the reply is in and both buses run in parallel. A servo that does not answer is skipped.
+void Quadruped::readServoConfig(int16_t config[][ConfigFields], bool answered[]){
+    int8_t handle[LSS_MaxBuses];
+    uint8_t job[LSS_MaxBuses], next[LSS_MaxBuses];
+    for(uint8_t b = 0; b < LSS_MaxBuses; b++){
+        handle[b] = -1;
+        next[b] = 0;
+    }
+    for(uint8_t i = 0; i < 12; i++) answered[i] = true;
+
+    bool busy = true;
+    while(busy){
+        busy = false;
+        LSS::pollBuses();
+        for(uint8_t b = 0; b < LSS_MaxBuses; b++){
+            LSSBus &bus = LSS::getBus(b);
+            if(!bus.isOpen()) continue;
+            if(handle[b] >= 0){
+                LSS_QueryResult result;
+                if(!bus.getResult(handle[b], result)){
+                    busy = true;
+                    continue;
+                }
+                handle[b] = -1;
+                uint8_t i = job[b]/ConfigFields;
+                if(result.status == LSS_CommStatus_ReadSuccess){
+                    config[i][job[b]%ConfigFields] = result.value;
+                }else{
+                    answered[i] = false;
+                    next[b] = (i + 1)*ConfigFields;
+                }
+            }
+            // Next query of this bus
+            while(next[b] < 12*ConfigFields){
+                uint8_t i = next[b]/ConfigFields;
+                if(answered[i] && &LSS::getBusForID(servo_ids[i]) == &bus) break;
+                next[b]++;
+            }
+            if(next[b] >= 12*ConfigFields) continue;
+            job[b] = next[b]++;
+            uint8_t i = job[b]/ConfigFields;
+            uint8_t field = job[b]%ConfigFields;
+            LSS_QueryType plane = (field == ConfigMotionControl) ? LSS_QuerySession : LSS_QueryConfig;  // EM is not stored
+            handle[b] = bus.request(servo_ids[i], config_queries[field], plane, nullptr, bus.getReplyTimeout(servo_ids[i])/1000 + 1);
+            if(handle[b] < 0) answered[i] = false;
+            else busy = true;
+        }
+    }
+}
+
+// Hash of the config stored in the servos (EM excluded, it is not stored)
+uint16_t Quadruped::configHash(void){
+    uint16_t hash = 0xFFFF;
+    for(uint8_t i = 0; i < 12; i++){
+        int16_t config[ConfigFields];
+        this->desiredConfig(i, config);
+        hash = crc16((const uint8_t *)config, ConfigMotionControl*sizeof(int16_t), hash);
+    }
+    return hash;
+}
+#endif
+
+// Time from initServoBus to the first frame sent to the servos (ms), 0 before it
+uint32_t Quadruped::getTimeToFirstStep(void){
+    return this->first_step;
+}
+
+// Servos rewritten by the last boot (12 for a blind configuration)
+uint8_t Quadruped::getReconfiguredServos(void){
+    return this->reconfigured;
+}
+
+// EEPROM address (2 bytes) of the hash of the servos config, to keep clear of what the sketch stores there.
+// Call before initServoBus.
+void Quadruped::setConfigHashAddress(uint16_t address){
+#ifdef QUADRUPED_SupportFastBoot
+    this->config_hash_address = address;
+#else
+    (void) address;
+#endif
 }
 
 void Quadruped::initMCUBus(ControlMode ctrl, HardwareSerial &s, uint32_t baud){
@@ -87,8 +319,8 @@ void Quadruped::walk(int16_t angle){
 
     if(this->robot.stopped && this->robot.new_move_state == StopWalk){
         this->changeSpeed(StopMoveSpeed);
-    }else if(this->speed != this->actual_speed){        
-        this->changeSpeed(this->speed);
+    }else if(this->deratedSpeed() != this->actual_speed){        
+        this->changeSpeed(this->deratedSpeed());
     }   
 }
 
@@ -96,8 +328,8 @@ void Quadruped::rotate(Rotation_Dir dir){
     this->move_flag = true;
     this->robot.update_flag = true;
     this->robot.new_rot_angle = dir;
-    if(this->speed != this->actual_speed){        
-        this->changeSpeed(this->speed);
+    if(this->deratedSpeed() != this->actual_speed){        
+        this->changeSpeed(this->deratedSpeed());
     }
 }
 
@@ -195,37 +427,156 @@ void Quadruped::changeSpeed(int8_t speed){
     {
         case StopMoveSpeed:
             this->dt.updateDT(60);
-            if(this->speed == 4){this->robot.new_beta = Dynamic;}
+            if(this->deratedSpeed() == 4){this->robot.new_beta = Dynamic;}
             else{this->robot.new_beta = Static;}
-            LSS::LSS(254).setFilterPositionCount(14);
             break;
         case SpecialMoveSpeed:
             this->dt.updateDT(180);
-            LSS::LSS(254).setFilterPositionCount(14);
             break;
         case 1:
             this->dt.updateDT(70);
             this->robot.new_beta = Static;
-            LSS::LSS(254).setFilterPositionCount(4); 
             break;
         case 2:
             this->dt.updateDT(60);
             this->robot.new_beta = Static;
-            LSS::LSS(254).setFilterPositionCount(4);
             break;
         case 3:
             this->dt.updateDT(50);
             this->robot.new_beta = Static;
-            LSS::LSS(254).setFilterPositionCount(3);
             break;
         case 4:
             this->dt.updateDT(55);
             this->robot.new_beta = Dynamic;
-            LSS::LSS(254).setFilterPositionCount(3);
             break;
         default:
             break;
     }
+    int8_t count = this->filterCount(speed);
+    if(count > 0) LSS::LSS(254).setFilterPositionCount(count);
+}
+
+// Servo filter position count used at each speed, -1 if the speed is unknown
+int8_t Quadruped::filterCount(int8_t speed){
+    switch (speed)
+    {
+        case StopMoveSpeed:
+        case SpecialMoveSpeed:
+            return 14;
+        case 1:
+        case 2:
+            return 4;
+        case 3:
+        case 4:
+            return 3;
+        default:
+            return -1;
+    }
+}
+
+// Timed moves need the servo motion profile (EM1), streamed poses run without it (EM0)
+void Quadruped::setOutputMode(ServoOutputMode mode){
+    this->output_mode = mode;
+    this->robot.joints.resetSentFrame();
+    LSS(254).setMotionControlEnabled(mode == TimedOutput);
+}
+
+// Round-robin QD/QV/QT/QC/Q sweep of the 12 servos, latest values in monitor.table
+void Quadruped::enableTelemetry(bool enable){
+    this->monitor.enabled = enable;
+}
+
+// Compare the servo positions with the commanded joint angles and watch for Stuck/Blocked servos.
+// threshold in 1/10°; the flags are in monitor.tracking
+void Quadruped::enableTracking(bool enable, int16_t threshold){
+    this->monitor.tracking_enabled = enable;
+    this->monitor.tracking_threshold = threshold;
+}
+
+// Bit n set: servo index n (ID 11 -> bit 0 ... ID 43 -> bit 11) does not follow its commands
+uint16_t Quadruped::getTrackingFaults(void){
+    return this->monitor.getTrackingFaults();
+}
+
+// Scale speed, step length and stiffness down as the servos get hot, the battery sags or the
+// current rises, and back up once they recover. Needs the telemetry sweep, enabled here too.
+void Quadruped::enableDerating(bool enable){
+    this->derating = enable;
+    if(enable) this->monitor.enabled = true;
+}
+
+// % of the step length in use (100 = not derated)
+uint8_t Quadruped::getDerating(void){
+    return this->derate_scale;
+}
+
+// How far the worst fresh sample of a field is from start towards limit (0-100 %)
+uint8_t Quadruped::derateLevel(uint8_t field, int16_t start, int16_t limit){
+    uint8_t level = 0;
+    uint32_t now = millis();
+    for(uint8_t i = 0; i < MONITOR_Servos; i++){
+        const ServoTelemetry &t = this->monitor.table[i];
+        if(t.timestamp[field] == 0 || now - t.timestamp[field] > DERATE_SampleAge) continue;
+        int32_t l = ((int32_t)t.value[field] - start)*100/((int32_t)limit - start);
+        if(l > 100) l = 100;
+        if(l > level) level = l;
+    }
+    return level;
+}
+
+// Fastest speed allowed at the current derating: 4 (dynamic gait) when not derated, 1 at full derating
+int8_t Quadruped::deratedSpeed(void){
+    int8_t allowed = 1 + (int16_t)(this->derate_scale - DERATE_MinScale)*4/(100 - DERATE_MinScale);
+    if(allowed > 4) allowed = 4;
+    return this->speed > allowed ? allowed : this->speed;
+}
+
+void Quadruped::derate(void){
+    if(!this->derating || millis() - this->derate_time < DERATE_Period) return;
+    this->derate_time = millis();
+
+    uint8_t level = this->derateLevel(MonitorTemperature, DERATE_TempStart, DERATE_TempLimit);
+    uint8_t l = this->derateLevel(MonitorVoltage, DERATE_VoltageStart, DERATE_VoltageLimit);
+    if(l > level) level = l;
+    l = this->derateLevel(MonitorCurrent, DERATE_CurrentStart, DERATE_CurrentLimit);
+    if(l > level) level = l;
+    uint8_t target = 100 - (uint16_t)level*(100 - DERATE_MinScale)/100;
+
+    // Down quickly, back up slowly: the temperature takes time to settle
+    if(target + DERATE_StepDown < this->derate_scale) this->derate_scale -= DERATE_StepDown;
+    else if(target > this->derate_scale + DERATE_StepUp) this->derate_scale += DERATE_StepUp;
+    else this->derate_scale = target;
+    this->robot.step_scale = this->derate_scale;
+
+    // Walking faster than allowed now (or allowed again)
+    if(!this->robot.stopped && this->actual_speed >= 1 && this->actual_speed <= 4 && this->actual_speed != this->deratedSpeed()){
+        this->changeSpeed(this->deratedSpeed());
+    }
+
+    // Softer servos draw less current, one session write when the stiffness changes
+    int8_t stiffness = ServoStiffness - ((100 - this->derate_scale)*DERATE_StiffnessDrop + (100 - DERATE_MinScale)/2)/(100 - DERATE_MinScale);
+    if(stiffness != this->derate_stiffness){
+        this->derate_stiffness = stiffness;
+        LSS(254).setAngularStiffness(stiffness, LSS_SetSession);
+    }
+}
+
+void Quadruped::sendFrame(void){
+    if(!this->stepped){
+        this->first_step = millis() - this->boot_start;
+        this->stepped = true;
+    }
+    if(this->output_mode == TimedOutput){
+        // Reach the keyframe when the next one is due
+        this->robot.joints.moveServosTimed((uint16_t)this->dt.dt);
+    }else{
+        this->robot.joints.moveServos();
+    }
+    int16_t angles[MONITOR_Servos];
+    for(uint8_t i = 0; i < MONITOR_Servos; i++){
+        angles[i] = this->robot.joints.servoAngle(i/3, i%3);
+    }
+    this->monitor.setCommanded(angles);
 }
 
 LSS_Robot_Model Quadruped::getRobotModel(void){
@@ -293,6 +644,9 @@ void Quadruped::triggerMotion(bool debug){
         case MCU_Jog_Off:
             this->specialMove(JOG_OFF);
             break;
+        case MCU_Sequence:
+            this->startSequence(this->last_cmd[1]);
+            break;
         default:
             this->walk(StopWalk);
             this->rotate(StopRotation);
@@ -307,28 +661,134 @@ void Quadruped::triggerMotion(bool debug){
     }
 }
 
+// Drains every complete command received since the last tick. The newest value of each motion
+// register wins and they are applied together, before the gait runs; special moves keep their
+// place in the order (the registers received before one are applied first). The registers of
+// a batch frame arrive whole, so they can't be split over two ticks. In WifiStreaming mode the
+// newest full body setpoint is applied last.
 void Quadruped::readSerial(void){
-    //MCU::MCU().motionRead(this->last_cmd);
-    MCU::MCU().genericRead(this->last_cmd);
-    MCU_LastCommStatus status = MCU().getLastCommStatus();
-    if (status != 0) Serial.println(status);
-    switch (status)
-    {
-        case MCU_CommStatus_Idle:
-            /* code */
-            break;
-        case MCU_CommStatus_ReadSuccess:
+    MCU_Command command;
+    int16_t values[MotionRegisters];
+    uint16_t pending = 0;
+    int16_t speed = 0;
+#ifdef MCU_SupportBinary
+    MCU_Setpoint received;
+    bool streamed = false;
+#endif
+    for(uint8_t n = 0; n < MaxCommandsPerTick; n++){
+        MCU::genericRead(command);
+        MCU_LastCommStatus status = MCU().getLastCommStatus();
+        if(status == MCU_CommStatus_Idle || status == MCU_CommStatus_ReadNoBus) break;
+        if(status == MCU_CommStatus_ReadSuccess || status == MCU_CommStatus_WriteSuccess) this->link_time = millis();
+        if(status != MCU_CommStatus_ReadSuccess) continue;
+        if(command.tag >= 0){   // timing echo, replaces the one in progress if any
+            this->echo_tag = command.tag;
+            this->echo_applied = false;
+            this->echo_received = micros();
+        }
+        if(command.reg != MCU_Sequence) this->stopSequence();   // the controller takes over
+        if(command.reg == MCU_SequenceData){
+#ifdef QUADRUPED_SupportSequences
+            this->storeSequence();
+#endif
+            continue;
+        }
+        if(command.reg == MCU_BatchData){   // all its registers are applied in this tick
+            uint8_t batch_speed, count;
+            MCU_Register registers[MCU_BatchMaxRegisters];
+            if(!MCU::getBatch(batch_speed, registers, count)) continue;
+            if(batch_speed != 0) speed = batch_speed;
+            for(uint8_t i = 0; i < count; i++){
+                values[registers[i].reg] = registers[i].value;
+                pending |= 1 << registers[i].reg;
+            }
+            continue;
+        }
+        if(command.reg == MCU_Streaming){
+#ifdef MCU_SupportBinary
+            if(this->ctrlSelected == WifiStreaming && this->acceptSetpoint(received)) streamed = true;
+#endif
+            continue;
+        }
+        if(command.speed != 0) speed = command.speed;
+        if(command.reg < MotionRegisters){
+            values[command.reg] = command.value;
+            pending |= 1 << command.reg;
+        }else{
+            this->applyRegisters(pending, values, speed);
+            pending = 0;
+            speed = 0;
+            this->last_cmd[0] = command.reg;
+            this->last_cmd[1] = command.value;
+            this->last_cmd[2] = 0;
             this->triggerMotion(false);
-            break;
-        case MCU_CommStatus_ReadTimeout:
-            /* code */
-            break;
-        case MCU_CommStatus_ReadNoBus:
-            /* code */
-            break;
-        default:
-            break;
+        }
+    }
+    this->applyRegisters(pending, values, speed);
+#ifdef MCU_SupportBinary
+    if(streamed) this->applySetpoint(received);
+#endif
+}
+
+void Quadruped::applyRegisters(uint16_t pending, const int16_t values[MotionRegisters], int16_t speed){
+    if(speed != 0) this->setSpeed(speed);
+    for(uint8_t reg = 0; reg < MotionRegisters; reg++){
+        if(!(pending & (1 << reg))) continue;
+        this->last_cmd[0] = reg;
+        this->last_cmd[1] = values[reg];
+        this->last_cmd[2] = 0;
+        this->triggerMotion(false);
+    }
+}
+
+#ifdef MCU_SupportBinary
+// Setpoints older than (or as old as) the last accepted one are dropped; after StreamResyncTime
+// without setpoint any sequence number is accepted (host restarted)
+bool Quadruped::acceptSetpoint(MCU_Setpoint &received){
+    MCU_Setpoint sp;
+    if(!MCU::getSetpoint(sp)) return false;
+    uint32_t now = millis();
+    if(this->streaming && now - this->setpoint_time < StreamResyncTime){
+        if((int16_t)(sp.sequence - this->setpoint_sequence) <= 0){
+            this->stale_setpoints++;
+            return false;
+        }
+    }else{
+        this->setpoint_applied = false;     // (re)started: the first setpoint is applied in full
     }
+    this->streaming = true;
+    this->setpoint_time = now;
+    this->setpoint_sequence = sp.sequence;
+    received = sp;
+    return true;
+}
+
+// Only what changed since the previous setpoint is applied, so a constant stream does not
+// restart the walk trajectory every frame
+void Quadruped::applySetpoint(const MCU_Setpoint &sp){
+    bool all = !this->setpoint_applied;
+    const MCU_Setpoint &last = this->setpoint;
+    if(sp.speed != 0) this->setSpeed(sp.speed);
+    if(all || sp.walk != last.walk || sp.speed != last.speed) this->walk(sp.walk);
+    if(all || sp.rotation != last.rotation) this->rotate(sp.rotation < 0 ? CCW : (sp.rotation > 0 ? CW : StopRotation));
+    if(all || sp.roll != last.roll) this->roll(sp.roll);
+    if(all || sp.pitch != last.pitch) this->pitch(sp.pitch);
+    if(all || sp.yaw != last.yaw) this->yaw(sp.yaw);
+    if(all || sp.frontal != last.frontal) this->frontalOffset(sp.frontal);
+    if(all || sp.height != last.height) this->height(sp.height);
+    if(all || sp.lateral != last.lateral) this->lateralOffset(sp.lateral);
+    this->setpoint = sp;
+    this->setpoint_applied = true;
+}
+#endif
+
+// Setpoints dropped because a newer one had already been received (WifiStreaming)
+uint16_t Quadruped::getStaleSetpoints(void){
+#ifdef MCU_SupportBinary
+    return this->stale_setpoints;
+#else
+    return 0;
+#endif
 }
 
 #ifdef MCU_SupportPPM
@@ -450,24 +910,264 @@ void Quadruped::readPPM(void){
 #endif
 
 void Quadruped::loop(void){
+    LSS::pollBuses();   // replies of the non-blocking servo queries, never waits
     if(this->dt.getDT()){
+        uint32_t tick_start = micros();
+        // The frame computed in the previous tick leaves first: the output latency is one tick,
+        // whatever the IK time, and the UART drains it while the next frame is computed
+        if(this->frame_pending){
+            this->sendFrame();
+            this->frame_pending = false;
+            this->monitor.frameSent(this->output_mode == TimedOutput ? LSS_MoveCommandLength + 5 : LSS_MoveCommandLength);
+            this->echoFrameSent(true);
+        }else{
+            this->monitor.frameSent(0);
+            this->echoFrameSent(false);
+        }
+        MCU::serviceBridge();   // servo commands from the controller, after the frame
         this->readControl();
+        this->runSequence();
+        this->checkLink();
+        this->derate();
         if(this->move_flag || !this->robot.stopped){
             if(this->robot.sp_move == UP) {
                 this->robot.walk(); // if up and balance option with IMU
-                this->robot.joints.moveServos();
                 if(this->robot.sp_move != UP) this->changeSpeed(SpecialMoveSpeed);
             }
             if(this->robot.sp_move != UP){
                 this->robot.specialMoves();
-                this->robot.joints.moveServos();
                 if(this->robot.sp_move == UP) this->changeSpeed(StopMoveSpeed);
             } 
+            this->robot.joints.publishFrame();
+            this->frame_pending = true;
             this->move_flag = false;
         }
+        // A timed command is applied once the body has picked it up (update_traj done)
+        if(this->echo_tag >= 0 && !this->echo_applied && !this->robot.update_flag){
+            this->echo_applied = true;
+            this->echo_apply_time = micros();
+        }
         //Serial.print(">>>>>>>>  ");
         //this->dt.getDT(true);
+        this->ticks++;
+        uint32_t elapsed = micros() - tick_start;
+        this->tick_us = elapsed > 0xFFFF ? 0xFFFF : elapsed;
+        if(this->tick_us > this->tick_us_max) this->tick_us_max = this->tick_us;
+        if(this->dt.late > this->late_max) this->late_max = this->dt.late;
+        this->sendTelemetry();
     }	
+    // Servo telemetry in the bus time left before the next tick
+    this->monitor.update(this->dt.remaining());
+}
+
+// Deadman of the WiFi link: without any valid command for ms (0 = never) the robot stops through
+// the normal gait, then levels its body and returns to the stance offsets, a little every tick
+void Quadruped::setLinkTimeout(uint16_t ms){
+    this->link_timeout = ms;
+    this->link_time = millis();
+}
+
+// Servo bridge on the MCU link: any LSS command (queries too) is forwarded between gait frames
+// and the servo replies are sent back (see MCU::setBridge)
+void Quadruped::enableBridge(bool enable){
+    MCU::setBridge(enable);
+}
+
+// True from the link timeout until the next command
+bool Quadruped::isLinkLost(void){
+    return this->link_lost;
+}
+
+static int16_t approach(int16_t value, int16_t target, int16_t step){
+    if(value < target - step) return value + step;
+    if(value > target + step) return value - step;
+    return target;
+}
+
+void Quadruped::checkLink(void){
+    if(this->link_timeout == 0 || (this->ctrlSelected != WifiRC && this->ctrlSelected != WifiStreaming)) return;
+    if(this->isSequenceRunning()) this->link_time = millis();   // the sequence is in control
+    if(millis() - this->link_time < this->link_timeout){
+        this->link_lost = false;
+        return;
+    }
+    if(!this->link_lost){
+        this->link_lost = true;
+        if(this->robot.new_jog_mode) this->specialMove(JOG_OFF);
+        this->walk(StopWalk);
+        this->rotate(StopRotation);
+#ifdef MCU_SupportBinary
+        this->setpoint_applied = false;     // the next setpoint is applied in full
+#endif
+    }
+    // Stance, once the gait has come to a stop (sit, lay... are kept)
+    if(!this->robot.stopped || this->robot.sp_move != UP) return;
+    int16_t angle = round(DEG(this->robot.roll));
+    if(angle != 0) this->roll(approach(angle, 0, LINK_SettleAngle));
+    angle = round(DEG(this->robot.pitch));
+    if(angle != 0) this->pitch(approach(angle, 0, LINK_SettleAngle));
+    angle = round(DEG(this->robot.yaw));
+    if(angle != 0) this->yaw(approach(angle, 0, LINK_SettleAngle));
+    int16_t cgx = this->robot.beta == Dynamic ? Body::cgx_dynamic_gait : Body::cgx_static_gait;
+    if(this->robot.cgx != cgx) this->frontalOffset(approach(this->robot.cgx, cgx, LINK_SettleOffset));
+    if(this->robot.cgy != Body::cgy_std) this->height(approach(this->robot.cgy, Body::cgy_std, LINK_SettleOffset));
+    if(this->robot.cgz != Body::cgz_std) this->lateralOffset(approach(this->robot.cgz, Body::cgz_std, LINK_SettleOffset));
+}
+
+// Motion sequence: timed motion commands played by the robot itself (M17 V<runs>), so their timing
+// does not depend on the link. Uploaded in MCU_BinarySequence frames or set by the sketch.
+// A step is stored at index <= length (the sequence grows by one at a time); false if refused.
+bool Quadruped::setSequenceStep(uint8_t index, const MCU_SequenceStep &step){
+#ifdef QUADRUPED_SupportSequences
+    if(index > this->sequence_length || index >= SEQUENCE_MaxSteps) return false;
+    // Motion registers or predefined moves only (the gap after MCU_GaitType is not a register)
+    bool motion = step.reg <= MCU_GaitType;
+    bool move = step.reg >= MCU_Up && step.reg <= MCU_Jog_Off && step.reg != MCU_Sequence;
+    if(!motion && !move) return false;
+    this->stopSequence();
+    this->sequence[index] = step;
+    if(index == this->sequence_length) this->sequence_length++;
+    return true;
+#else
+    (void) index;
+    (void) step;
+    return false;
+#endif
+}
+
+uint8_t Quadruped::getSequenceLength(void){
+#ifdef QUADRUPED_SupportSequences
+    return this->sequence_length;
+#else
+    return 0;
+#endif
+}
+
+// Play the sequence runs times (0: once, -1: until stopped); any command from the controller stops it
+void Quadruped::startSequence(int16_t runs){
+#ifdef QUADRUPED_SupportSequences
+    if(this->sequence_length == 0) return;
+    this->sequence_runs = runs == 0 ? 1 : (runs < 0 ? -1 : runs);
+    this->sequence_step = 0;
+    this->sequence_time = millis() + this->sequence[0].delay;
+#else
+    (void) runs;
+#endif
+}
+
+void Quadruped::stopSequence(void){
+#ifdef QUADRUPED_SupportSequences
+    this->sequence_runs = 0;
+#endif
+}
+
+bool Quadruped::isSequenceRunning(void){
+#ifdef QUADRUPED_SupportSequences
+    return this->sequence_runs != 0;
+#else
+    return false;
+#endif
+}
+
+#ifdef QUADRUPED_SupportSequences
+// Steps of the MCU_BinarySequence frame just read; the controller gets the steps stored back
+void Quadruped::storeSequence(void){
+    uint8_t first, count;
+    MCU_SequenceStep steps[MCU_SequenceFrameSteps];
+    if(!MCU::getSequenceSteps(first, steps, count)) return;
+    if(first == 0) this->sequence_length = 0;
+    for(uint8_t i = 0; i < count; i++){
+        if(!this->setSequenceStep(first + i, steps[i])) break;
+    }
+    MCU::writeReply(MCU_SequenceReply, this->sequence_length);
+}
+#endif
+
+// Steps due are applied from a fixed schedule (start + delays), whatever the tick they land on
+void Quadruped::runSequence(void){
+#ifdef QUADRUPED_SupportSequences
+    for(uint8_t n = 0; n < this->sequence_length && this->sequence_runs != 0; n++){
+        if((int32_t)(millis() - this->sequence_time) < 0) return;
+        const MCU_SequenceStep &step = this->sequence[this->sequence_step];
+        if(step.speed != 0) this->setSpeed(step.speed);
+        this->last_cmd[0] = step.reg;
+        this->last_cmd[1] = step.value;
+        this->last_cmd[2] = 0;
+        this->triggerMotion(false);
+        if(++this->sequence_step >= this->sequence_length){
+            this->sequence_step = 0;
+            if(this->sequence_runs > 0) this->sequence_runs--;
+        }
+        this->sequence_time += this->sequence[this->sequence_step].delay;
+    }
+#endif
+}
+
+// Timing echo of the command tagged E<tag>, once the first frame computed with it has left
+void Quadruped::echoFrameSent(bool sent){
+    if(this->echo_tag < 0 || !this->echo_applied) return;
+    MCU::writeEcho(this->echo_tag, this->echo_received, this->echo_apply_time, sent ? micros() : 0);
+    this->echo_tag = -1;
+}
+
+// Telemetry frames on the MCU link every ms (0 = off); they are only sent when they fit in the
+// transmit buffer, so they never hold the control loop. Call after initMCUBus: returns false (telemetry
+// stays off) if the link cannot send them, ex: a SoftwareSerial link (see MCU::canWriteBinary)
+bool Quadruped::setTelemetryPeriod(uint16_t ms){
+    bool sendable = (ms == 0 || MCU::canWriteBinary());
+    this->telemetry_period = sendable ? ms : 0;
+    this->telemetry_time = millis();
+    return sendable;
+}
+
+// Telemetry frames skipped because the transmit buffer was full
+uint16_t Quadruped::getDroppedTelemetry(void){
+    return this->telemetry_dropped;
+}
+
+static void putInt16(uint8_t *&f, int16_t value){
+    *f++ = value & 0xFF;
+    *f++ = (uint16_t)value >> 8;
+}
+
+// MCU_BinaryTelemetry fields, little-endian:
+//  ticks (u32), cont (u8), beta (u8), sp_move (u8),
+//  roll, pitch, yaw (i16, 1/10 deg), cgx, cgy, cgz (i16, mm),
+//  12 commanded joint angles (i16, 1/10 deg, leg by leg),
+//  tick time last and max (u16, us), late max (i16, ms), dropped frames (u16),
+//  status flags (u8, Telemetry*)
+void Quadruped::sendTelemetry(void){
+    if(this->telemetry_period == 0 || millis() - this->telemetry_time < this->telemetry_period) return;
+    this->telemetry_time += this->telemetry_period;
+    if(millis() - this->telemetry_time >= this->telemetry_period) this->telemetry_time = millis();  // fell behind
+
+    uint8_t fields[TelemetryLength];
+    uint8_t *f = fields;
+    putInt16(f, this->ticks & 0xFFFF);
+    putInt16(f, this->ticks >> 16);
+    *f++ = this->robot.getCont();
+    *f++ = this->robot.beta;
+    *f++ = this->robot.sp_move;
+    putInt16(f, DEG(this->robot.roll)*10);
+    putInt16(f, DEG(this->robot.pitch)*10);
+    putInt16(f, DEG(this->robot.yaw)*10);
+    putInt16(f, this->robot.cgx);
+    putInt16(f, this->robot.cgy);
+    putInt16(f, this->robot.cgz);
+    for(uint8_t i = 0; i < 12; i++){
+        putInt16(f, this->robot.joints.servoAngle(i/3, i%3));
+    }
+    putInt16(f, this->tick_us);
+    putInt16(f, this->tick_us_max);
+    putInt16(f, this->late_max);
+    putInt16(f, this->telemetry_dropped);
+    *f++ = this->link_lost ? TelemetryLinkLost : 0;
+    if(MCU::writeBinary(MCU_BinaryTelemetry, fields, f - fields)){
+        this->tick_us_max = 0;
+        this->late_max = 0;
+    }else{
+        this->telemetry_dropped++;
+    }
 }
 
 void Quadruped::readControl(void){
@@ -477,9 +1177,7 @@ void Quadruped::readControl(void){
     case NoControlSelected:
         /* code */
         break;
-    // case WifiStreaming:
-    //     this->readStreaming();
-    //     break;
+    case WifiStreaming:
     case WifiRC:
         this->readSerial();
         break;
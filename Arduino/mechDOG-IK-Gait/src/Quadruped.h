@@ -12,10 +12,24 @@
 #ifndef QUADRUPED_H
 #define QUADRUPED_H
 
+#define QUADRUPED_SupportFastBoot
+// Uncomment the line below to configure the servos blindly on every boot (no read back, no EEPROM use).
+//#undef QUADRUPED_SupportFastBoot
+
+#define QUADRUPED_SupportSequences
+// Uncomment the line below to remove the motion sequences (M17), freeing some RAM. They are uploaded in binary frames.
+//#undef QUADRUPED_SupportSequences
+
 #include "LSS.h"
 #include "LSS_MCU.h"
 #include "IK_quad.h"
 #include "Utils.h"
+#include "ServoMonitor.h"
+
+#if defined(__AVR__) || !defined(MCU_SupportBinary)
+// Left out of the AVR boards (2 KB of RAM, see LSS.h), comment out the line below to use them anyway
+#undef QUADRUPED_SupportSequences
+#endif
 
 #ifdef MCU_SupportPPM
 #include "ppm.h"
@@ -23,14 +37,55 @@
 
 #define SpecialMoveSpeed 0
 #define StopMoveSpeed 5
+#ifndef ConfigHashAddress
+#define ConfigHashAddress 0     // default EEPROM address of the hash of the config stored in the servos (2 bytes), see setConfigHashAddress
+#endif
+#define ServoStiffness -2
+#define ServoHoldingStiffness 1
+#define MaxCommandsPerTick 16   // MCU commands drained from the link per tick, at most
+#define MotionRegisters (MCU_GaitType + 1)  // registers that hold a value (walk ... gait type)
+#define StreamResyncTime 500    // ms without setpoint after which any sequence number is accepted again
+#define TelemetryLength 52      // fields of a MCU_BinaryTelemetry frame (see sendTelemetry)
+#define TelemetryLinkLost 0x01  // telemetry status flags
+#define LINK_SettleAngle 1      // deg per tick the body is levelled by after a link loss
+#define LINK_SettleOffset 2     // mm per tick the cg offsets return to the stance by
+#define SEQUENCE_MaxSteps 16    // steps of the motion sequence kept in RAM
+
+//> Gait derating, from the servo telemetry (worst servo). Derating starts at *Start and is full at *Limit
+#define DERATE_TempStart 550        // 1/10°C
+#define DERATE_TempLimit 700
+#define DERATE_VoltageStart 10800   // mV (3S battery: 3.6 V/cell)
+#define DERATE_VoltageLimit 10200   //              3.4 V/cell
+#define DERATE_CurrentStart 1000    // mA
+#define DERATE_CurrentLimit 1600
+#define DERATE_MinScale 50          // % of the step length left at full derating
+#define DERATE_StiffnessDrop 3      // angular stiffness removed at full derating
+#define DERATE_SampleAge 5000       // ms, older telemetry is ignored
+#define DERATE_Period 200           // ms, the scale moves by at most
+#define DERATE_StepDown 5           //  5% down
+#define DERATE_StepUp 1             //  or 1% up per period
 
 enum ControlMode{
     NoControlSelected,
-    //WifiStreaming,
+    WifiStreaming,      // WifiRC + full body setpoints streamed by the host (MCU_BinarySetpoint)
     WifiRC,
     RC,
 };
 
+enum ServoOutputMode{
+    StreamedOutput,     // every pose is streamed, the servos only filter (EM0 + FPC)
+    TimedOutput,        // each pose is sent once as a timed move, the servos interpolate (EM1 + T)
+};
+
+enum ServoConfigField{
+    ConfigGyre,
+    ConfigStiffness,
+    ConfigHoldingStiffness,
+    ConfigFilterCount,
+    ConfigMotionControl,    // session only, not part of the stored config
+    ConfigFields,
+};
+
 enum RCSwitchMode{
     OffsetMode,
     WalkingMode,
@@ -56,11 +111,17 @@ class Quadruped
     bool move_flag = true;
     ControlMode ctrlSelected = NoControlSelected;
     RCSwitchMode RC_mode;
+    ServoOutputMode output_mode = StreamedOutput;
+    bool frame_pending = false;
+    ServoMonitor monitor;
 
     Quadruped(LSS_Robot_Model robot = MechDog);
     ~Quadruped(void);
     
-    void initServoBus(HardwareSerial &s, uint32_t baud);
+    void initServoBus(HardwareSerial &s, uint32_t baud, bool auto_baud = false);
+#if LSS_MaxBuses > 1
+    void initServoBus(HardwareSerial &front, HardwareSerial &rear, uint32_t baud, bool auto_baud = false);
+#endif
     void initMCUBus(ControlMode ctrl, HardwareSerial &s, uint32_t baud);
 #ifdef MCU_SupportSoftwareSerial
     void initMCUBus(ControlMode ctrl, SoftwareSerial &s, uint32_t baud);
@@ -83,14 +144,92 @@ class Quadruped
     LSS_Robot_Model getRobotModel(void);
     void setSpeed(uint8_t speed);
     void readControl(void);
+    uint16_t getMaxFrameRate(void);
+    void setOutputMode(ServoOutputMode mode);
+    void enableTelemetry(bool enable = true);
+    void enableTracking(bool enable = true, int16_t threshold = MONITOR_TrackingThreshold);
+    void enableDerating(bool enable = true);
+    uint8_t getDerating(void);
+    uint16_t getTrackingFaults(void);
+    uint32_t getTimeToFirstStep(void);
+    uint8_t getReconfiguredServos(void);
+    void setConfigHashAddress(uint16_t address);
+    uint16_t getStaleSetpoints(void);
+    bool setTelemetryPeriod(uint16_t ms);
+    void setLinkTimeout(uint16_t ms);
+    void enableBridge(bool enable = true);
+    bool setSequenceStep(uint8_t index, const MCU_SequenceStep &step);
+    uint8_t getSequenceLength(void);
+    void startSequence(int16_t runs = 1);
+    void stopSequence(void);
+    bool isSequenceRunning(void);
+    bool isLinkLost(void);
+    uint16_t getDroppedTelemetry(void);
     
     private:
     Body robot; 
+    void configServos(void);
+    void desiredConfig(uint8_t index, int16_t config[ConfigFields]);
+    void writeServoConfig(uint8_t index, LSS_SetType set_type);
+    void writeAllConfig(LSS_SetType set_type);
+#ifdef QUADRUPED_SupportFastBoot
+    bool fastBoot(void);
+    bool waitServos(void);
+    void readServoConfig(int16_t config[][ConfigFields], bool answered[]);
+    uint16_t configHash(void);
+    uint16_t config_hash_address = ConfigHashAddress;
+#endif
+    int8_t filterCount(int8_t speed);
+    bool derating = false;
+    uint8_t derate_scale = 100;
+    int8_t derate_stiffness = ServoStiffness;
+    uint32_t derate_time = 0;
+    void derate(void);
+    uint8_t derateLevel(uint8_t field, int16_t start, int16_t limit);
+    int8_t deratedSpeed(void);
+    uint32_t boot_start = 0, first_step = 0;
+    bool stepped = false;
+    uint8_t reconfigured = 0;
+    void upgradeServoBaud(uint32_t baud);
+    void sendFrame(void);
     DTime dt = DTime(100);
     int8_t speed = 1, actual_speed;
     void triggerMotion(bool debug);
     void changeSpeed(int8_t speed);
     void readSerial(void);
+    uint32_t ticks = 0;
+    uint16_t tick_us = 0, tick_us_max = 0;  // time spent in the tick, last and max since the last telemetry frame
+    int16_t late_max = 0;                   // ms a tick started after it was due, max since the last telemetry frame
+    uint16_t telemetry_period = 0;
+    uint32_t telemetry_time = 0;
+    uint16_t telemetry_dropped = 0;
+    void sendTelemetry(void);
+    int16_t echo_tag = -1;              // command being timed (E<tag>), -1: none
+    bool echo_applied = false;
+    uint32_t echo_received = 0, echo_apply_time = 0;
+    void echoFrameSent(bool sent);
+    uint16_t link_timeout = 0;
+    uint32_t link_time = 0;             // last command received
+    bool link_lost = false;
+    void checkLink(void);
+#ifdef QUADRUPED_SupportSequences
+    MCU_SequenceStep sequence[SEQUENCE_MaxSteps];
+    uint8_t sequence_length = 0, sequence_step = 0;
+    int16_t sequence_runs = 0;          // runs left, -1: forever, 0: stopped
+    uint32_t sequence_time = 0;         // millis() when the next step is due
+    void storeSequence(void);
+#endif
+    void runSequence(void);
+    void applyRegisters(uint16_t pending, const int16_t values[MotionRegisters], int16_t speed);
+#ifdef MCU_SupportBinary
+    MCU_Setpoint setpoint;              // last applied
+    uint16_t setpoint_sequence = 0;     // last accepted
+    uint32_t setpoint_time = 0;
+    uint16_t stale_setpoints = 0;
+    bool streaming = false, setpoint_applied = false;
+    bool acceptSetpoint(MCU_Setpoint &received);
+    void applySetpoint(const MCU_Setpoint &sp);
+#endif
 #ifdef MCU_SupportPPM
     void readPPM(void);
 #endif
@@ -0,0 +1,201 @@
+/*
+ *	Authors:		Eduardo Nunes
+ *					Geraldine Barreto
+ *	Version:		1.0
+ *	Licence:		LGPL-3.0 (GNU Lesser General Public License)
+ *	
+ *	Description:	Background servo telemetry and commanded vs actual position
+ *					tracking that use the bus time left after each frame,
+ *					without ever delaying the next one.
+ */
+
+#include "ServoMonitor.h"
+
+static const char * const monitor_queries[MonitorFields] = {LSS_QueryPosition, LSS_QueryVoltage, LSS_QueryTemperature, LSS_QueryCurrent, LSS_QueryStatus};
+
+ServoMonitor::ServoMonitor(void){
+    memset(this->table, 0, sizeof(this->table));
+    memset(this->tracking, 0, sizeof(this->tracking));
+}
+
+// Servo index in the table: leg*3 + joint (ID 11 -> 0 ... ID 43 -> 11), -1 if not a leg servo
+int8_t ServoMonitor::servoIndex(uint8_t id){
+    uint8_t leg = id/10;
+    uint8_t joint = id%10;
+    if(leg < 1 || leg > 4 || joint < 1 || joint > 3) return -1;
+    return (leg-1)*3 + joint-1;
+}
+
+uint8_t ServoMonitor::servoID(uint8_t index){
+    return (index/3 + 1)*10 + index%3 + 1;
+}
+
+const ServoTelemetry & ServoMonitor::getTelemetry(uint8_t id){
+    int8_t index = servoIndex(id);
+    if(index < 0) index = 0;
+    return this->table[index];
+}
+
+// Angles (1/10°) of the frame just sent, by servo index, as the servos received them
+void ServoMonitor::setCommanded(const int16_t angles[MONITOR_Servos]){
+    for(uint8_t i = 0; i < MONITOR_Servos; i++){
+        this->tracking[i].previous = this->commanded_valid ? this->tracking[i].commanded : angles[i];
+        this->tracking[i].commanded = angles[i];
+    }
+    this->commanded_valid = true;
+}
+
+// Bit n set: servo index n is flagged (Tracking_Flags in tracking[n].flags)
+uint16_t ServoMonitor::getTrackingFaults(void){
+    uint16_t faults = 0;
+    for(uint8_t i = 0; i < MONITOR_Servos; i++){
+        if(this->tracking[i].flags) faults |= 1 << i;
+    }
+    return faults;
+}
+
+// Transmission time of some bytes on a bus (us), 10 bits per byte
+uint32_t ServoMonitor::byteTime(LSSBus &bus, uint16_t bytes){
+    uint32_t baud = bus.getBaud();
+    if(baud == 0) baud = LSS_DefaultBaud;
+    return (uint32_t)bytes*10000000UL/baud;
+}
+
+// Called at the start of every tick: the queries must wait until the frame has left the bus
+void ServoMonitor::frameSent(uint8_t bytes_per_servo){
+    this->tick_queries = 0;
+    uint32_t longest = 0;
+    for(uint8_t b = 0; b < LSS_MaxBuses; b++){
+        LSSBus &bus = LSS::getBus(b);
+        if(!bus.isOpen()) continue;
+        uint8_t count = 0;
+        for(uint8_t i = 0; i < MONITOR_Servos; i++){
+            if(&LSS::getBusForID(servoID(i)) == &bus) count++;
+        }
+        uint32_t t = this->byteTime(bus, count*bytes_per_servo);
+        if(t > longest) longest = t;
+    }
+    this->frame_end_us = micros() + longest;
+}
+
+// Collect the last reply and, if the bus stays idle long enough before the next tick and the
+// bus share allows it, send the next query. slack_ms is the time left before the next tick.
+void ServoMonitor::update(int16_t slack_ms){
+    if(!this->enabled && !this->tracking_enabled) return;
+
+    // Bus share: a query spends its round trip / MONITOR_BusShare % of the elapsed time
+    uint32_t now = micros();
+    this->budget_us += now - this->budget_time;
+    this->budget_time = now;
+    if(this->budget_us > MONITOR_BudgetMax) this->budget_us = MONITOR_BudgetMax;
+
+    if(this->handle >= 0){
+        LSS_QueryResult result;
+        if(!this->handle_bus->getResult(this->handle, result)) return;     // still on the bus
+        this->handle = -1;
+        if(result.status == LSS_CommStatus_ReadSuccess){
+            this->table[this->handle_servo].value[this->handle_field] = result.value;
+            this->table[this->handle_servo].timestamp[this->handle_field] = result.timestamp;
+            if(this->tracking_enabled) this->track(this->handle_servo, this->handle_field, result.value);
+        }
+    }
+
+    if(this->tick_queries >= MONITOR_QueriesPerTick) return;
+    if((int32_t)(now - this->frame_end_us) < 0) return;                // frame still leaving
+
+    uint8_t servo, field;
+    bool tracked;
+    if(!this->nextQuery(servo, field, tracked)) return;
+    uint8_t id = servoID(servo);
+    LSSBus &bus = LSS::getBusForID(id);
+    if(!bus.isOpen()) return;
+
+    // Query + answer must be over before the next frame, the bus is half-duplex
+    uint32_t round_trip = this->byteTime(bus, MONITOR_QueryLength + MONITOR_ReplyLength) + MONITOR_ServoLatency;
+    uint16_t deadline = round_trip/1000 + 1;
+    if(slack_ms <= (int16_t)deadline) return;
+    uint32_t cost = round_trip*100/MONITOR_BusShare;
+    if(this->budget_us < cost) return;
+
+    this->handle = bus.request(id, monitor_queries[field], nullptr, deadline);
+    if(this->handle < 0) return;
+    this->budget_us -= cost;
+    this->handle_bus = &bus;
+    this->handle_servo = servo;
+    this->handle_field = field;
+    this->tick_queries++;
+
+    // Advance the sweep the query came from
+    if(tracked && this->recheck >= 0){
+        this->recheck = -1;
+    }else if(tracked){
+        this->track_servo++;
+        if(this->track_servo >= MONITOR_Servos){
+            this->track_servo = 0;
+            this->track_round++;
+        }
+    }else{
+        // Sweep every servo, then move to the next field
+        this->next_servo++;
+        if(this->next_servo >= MONITOR_Servos){
+            this->next_servo = 0;
+            this->next_field = (this->next_field + 1)%MonitorFields;
+        }
+    }
+    this->slot++;
+}
+
+// Servo and field of the next query:
+//  - a servo whose last position was off is sampled again right away
+//  - tracking sweeps the positions of every servo, with a status round every MONITOR_StatusEvery rounds
+//  - the telemetry sweep gets one query in MONITOR_TelemetryEvery (all of them without tracking)
+bool ServoMonitor::nextQuery(uint8_t &servo, uint8_t &field, bool &tracked){
+    tracked = this->tracking_enabled && this->commanded_valid;
+    if(tracked){
+        if(this->recheck >= 0){
+            servo = this->recheck;
+            field = MonitorPosition;
+            return true;
+        }
+        if(!this->enabled || this->slot%MONITOR_TelemetryEvery != 0){
+            servo = this->track_servo;
+            field = (this->track_round%MONITOR_StatusEvery == MONITOR_StatusEvery - 1) ? MonitorStatus : MonitorPosition;
+            return true;
+        }
+        // Positions and status already come from the tracking sweep
+        tracked = false;
+        while(this->next_field == MonitorPosition || this->next_field == MonitorStatus){
+            this->next_servo = 0;
+            this->next_field = (this->next_field + 1)%MonitorFields;
+        }
+    }
+    if(!this->enabled) return false;
+    servo = this->next_servo;
+    field = this->next_field;
+    return true;
+}
+
+// Compare a sample with the motion commanded to the servo
+void ServoMonitor::track(uint8_t servo, uint8_t field, int16_t value){
+    ServoTracking &t = this->tracking[servo];
+    if(field == MonitorStatus){
+        t.flags &= ~(TrackingStuck | TrackingBlocked);
+        if(value == LSS_StatusStuck) t.flags |= TrackingStuck;
+        if(value == LSS_StatusBlocked) t.flags |= TrackingBlocked;
+        return;
+    }
+    if(field != MonitorPosition || !this->commanded_valid) return;
+
+    // Anywhere between the previous and the last commanded angle is on track
+    int16_t low = t.previous < t.commanded ? t.previous : t.commanded;
+    int16_t high = t.previous < t.commanded ? t.commanded : t.previous;
+    t.error = value < low ? low - value : (value > high ? value - high : 0);
+    if(t.error > this->tracking_threshold){
+        if(t.over < 255) t.over++;
+        if(t.over < MONITOR_TrackingSamples) this->recheck = servo;    // confirm on the next query
+    }else{
+        t.over = 0;
+    }
+    if(t.over >= MONITOR_TrackingSamples) t.flags |= TrackingError;
+    else t.flags &= ~TrackingError;
+}
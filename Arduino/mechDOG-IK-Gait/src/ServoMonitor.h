@@ -0,0 +1,91 @@
+/*
+ *	Authors:		Eduardo Nunes
+ *					Geraldine Barreto
+ *	Version:		1.0
+ *	Licence:		LGPL-3.0 (GNU Lesser General Public License)
+ *	
+ *	Description:	Background servo telemetry and commanded vs actual position
+ *					tracking that use the bus time left after each frame,
+ *					without ever delaying the next one.
+ */
+
+#ifndef SERVO_MONITOR_H
+#define SERVO_MONITOR_H
+
+#include "Arduino.h"
+#include "LSS.h"
+
+#define MONITOR_Servos 12
+#define MONITOR_QueriesPerTick 2
+#define MONITOR_QueryLength 6           // ex: #11QD\r
+#define MONITOR_ReplyLength 12          // ex: *11QD-1800\r
+#define MONITOR_ServoLatency 1000       // in us, time before a servo starts answering
+#define MONITOR_BusShare 8              // % of the bus time the queries may use, averaged over a few ticks
+#define MONITOR_BudgetMax 100000        // in us, unused bus share kept for later (no burst after an idle time)
+#define MONITOR_TrackingThreshold 150   // in 1/10°, distance from the commanded motion before a sample counts as an error
+#define MONITOR_TrackingSamples 2       // consecutive samples over the threshold before a servo is flagged
+#define MONITOR_StatusEvery 4           // tracking: one Q status round every n position rounds
+#define MONITOR_TelemetryEvery 4        // tracking: one query in n goes to the telemetry sweep
+
+enum Monitor_Field{
+    MonitorPosition,
+    MonitorVoltage,
+    MonitorTemperature,
+    MonitorCurrent,
+    MonitorStatus,
+    MonitorFields
+};
+
+struct ServoTelemetry{
+    int16_t value[MonitorFields];           // 1/10°, mV, 1/10°C, mA, LSS_Status
+    uint32_t timestamp[MonitorFields];      // millis() of the reply, 0 = never read
+};
+
+enum Tracking_Flags{
+    TrackingError = 0x01,       // MONITOR_TrackingSamples position samples away from the commanded motion
+    TrackingStuck = 0x02,       // servo reports LSS_StatusStuck
+    TrackingBlocked = 0x04,     // servo reports LSS_StatusBlocked
+};
+
+struct ServoTracking{
+    int16_t commanded;          // 1/10°, last angle sent to the servo (after offsets and clamping)
+    int16_t previous;           // 1/10°, the one sent before: the servo may be anywhere in between
+    int16_t error;              // 1/10°, distance of the last position sample from that motion
+    uint8_t over;               // consecutive samples over the threshold
+    uint8_t flags;              // Tracking_Flags
+};
+
+class ServoMonitor
+{
+    public:
+        ServoTelemetry table[MONITOR_Servos];
+        ServoTracking tracking[MONITOR_Servos];
+        bool enabled = false;
+        bool tracking_enabled = false;
+        int16_t tracking_threshold = MONITOR_TrackingThreshold;
+
+        ServoMonitor(void);
+        void frameSent(uint8_t bytes_per_servo);
+        void setCommanded(const int16_t angles[MONITOR_Servos]);
+        void update(int16_t slack_ms);
+        const ServoTelemetry & getTelemetry(uint8_t id);
+        uint16_t getTrackingFaults(void);
+        static int8_t servoIndex(uint8_t id);
+        static uint8_t servoID(uint8_t index);
+
+    private:
+        uint8_t next_servo = 0, next_field = 0, tick_queries = 0;
+        uint8_t track_servo = 0, track_round = 0, slot = 0;
+        int8_t recheck = -1;
+        bool commanded_valid = false;
+        uint32_t budget_us = 0, budget_time = 0;
+        int8_t handle = -1;
+        uint8_t handle_servo, handle_field;
+        LSSBus * handle_bus;
+        uint32_t frame_end_us = 0;
+        uint32_t byteTime(LSSBus &bus, uint16_t bytes);
+        bool nextQuery(uint8_t &servo, uint8_t &field, bool &tracked);
+        void track(uint8_t servo, uint8_t field, int16_t value);
+};
+
+#endif
@@ -19,6 +19,11 @@ void DTime::reset(void){
     this->old_sample = millis();
 }   
 
+// Time left before the next period starts (ms), negative if it is already due
+int16_t DTime::remaining(void){
+    return this->dt - (int16_t)(millis() - this->old_sample);
+}
+
 void DTime::updateDT(int16_t dt){
     if(dt > 0) this->dt = dt;
 }      
@@ -35,10 +40,21 @@ bool DTime::getDT(bool debug = false){
     }       
 
     if (dt-this->dt >= 0){
+        this->late = dt-this->dt;
         this->old_sample = this->new_sample;
         return true;
     }else{
         return false;
     }
 }
-       
\ No newline at end of file
+
+// CRC-16/CCITT-FALSE; pass the previous result as crc to extend it over several blocks
+uint16_t crc16(const uint8_t * data, uint16_t length, uint16_t crc){
+    for(uint16_t i = 0; i < length; i++){
+        crc ^= (uint16_t)data[i] << 8;
+        for(uint8_t b = 0; b < 8; b++){
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
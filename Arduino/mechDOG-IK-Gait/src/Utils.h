@@ -19,7 +19,9 @@ class DTime
         void updateDT(int16_t dt);
         bool getDT(bool debug = false);
         void reset(void);
+        int16_t remaining(void);
         int16_t dt = 0;
+        int16_t late = 0;   // ms the last period started after it was due
         
     private:
         int32_t new_sample = 0;
@@ -27,4 +29,6 @@ class DTime
         
 };
 
+uint16_t crc16(const uint8_t * data, uint16_t length, uint16_t crc = 0xFFFF);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,56 @@
+/*
+ *	Description:	Host stand-in for the Arduino core (see Arduino.h).
+ */
+
+#include "Arduino.h"
+#include "EEPROM.h"
+#include "ppm.h"
+
+static unsigned long host_us = 0;
+
+void hostAdvance(unsigned long us)
+{
+	host_us += us;
+}
+
+unsigned long micros(void)
+{
+	host_us += HOST_ClockStep;
+	return (host_us);
+}
+
+unsigned long millis(void)
+{
+	return (micros() / 1000);
+}
+
+void delay(unsigned long ms)
+{
+	host_us += ms * 1000;
+}
+
+void delayMicroseconds(unsigned int us)
+{
+	host_us += us;
+}
+
+void pinMode(int pin, int mode)
+{
+	(void) pin;
+	(void) mode;
+}
+
+void digitalWrite(int pin, int value)
+{
+	(void) pin;
+	(void) value;
+}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max)
+{
+	return ((x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min);
+}
+
+HardwareSerial Serial;
+EEPROMClass EEPROM;
+PPM ppm;
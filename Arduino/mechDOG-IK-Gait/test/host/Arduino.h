@@ -0,0 +1,132 @@
+/*
+ *	Description:	Host stand-in for the Arduino core, just what the library uses.
+ *					Lets the library run on a PC against emulated streams (see Makefile).
+ *
+ *					The clock is simulated: every read of millis()/micros() moves it by
+ *					HOST_ClockStep us, so the busy waits of the library always end, and
+ *					delay() moves it by the whole delay.
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#define ARDUINO_HOST
+#define HOST_ClockStep	1		// us per clock read
+
+#define PI 3.1415926535897932384626433832795
+#define DEC 10
+#define HEX 16
+#define A0 14
+#define A3 17
+#define INPUT 0
+#define OUTPUT 1
+#define LOW 0
+#define HIGH 1
+#define F(x) (x)
+
+typedef uint8_t byte;
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+template<class T, class L, class H> T constrain(T x, L low, H high) { return (x < low ? low : (x > high ? high : x)); }
+
+// Simulated clock
+void hostAdvance(unsigned long us);
+
+class Print
+{
+public:
+	virtual ~Print() {}
+	virtual size_t write(uint8_t c) = 0;
+	virtual size_t write(const uint8_t * buffer, size_t size)
+	{
+		size_t n = 0;
+		while (size--)
+			n += write(*buffer++);
+		return (n);
+	}
+	size_t write(const char * s) { return (s == nullptr ? 0 : write((const uint8_t *) s, strlen(s))); }
+	virtual int availableForWrite(void) { return (0); }
+	virtual void flush(void) {}
+
+	size_t print(const char * s) { return (write(s)); }
+	size_t print(char c) { return (write((uint8_t) c)); }
+	size_t print(int n, int base = DEC) { return (print((long) n, base)); }
+	size_t print(unsigned int n, int base = DEC) { return (print((unsigned long) n, base)); }
+	size_t print(long n, int base = DEC) { return (printNumber(n < 0 && base == DEC ? "-" : "", n < 0 && base == DEC ? -(unsigned long) n : (unsigned long) n, base)); }
+	size_t print(unsigned long n, int base = DEC) { return (printNumber("", n, base)); }
+	size_t print(double n, int digits = 2)
+	{
+		char text[32];
+		snprintf(text, sizeof(text), "%.*f", digits, n);
+		return (write(text));
+	}
+	size_t println(void) { return (write("\r\n")); }
+	template<class T> size_t println(T value) { return (print(value) + println()); }
+	template<class T> size_t println(T value, int format) { return (print(value, format) + println()); }
+
+private:
+	size_t printNumber(const char * sign, unsigned long n, int base)
+	{
+		char text[24];
+		snprintf(text, sizeof(text), base == HEX ? "%s%lX" : "%s%lu", sign, n);
+		return (write(text));
+	}
+};
+
+class Stream : public Print
+{
+public:
+	virtual int available(void) = 0;
+	virtual int read(void) = 0;
+	virtual int peek(void) = 0;
+	void setTimeout(unsigned long ms) { timeout = ms; }
+	bool find(const char * target)
+	{
+		unsigned long start = millis();
+		size_t index = 0;
+		while (millis() - start < timeout)
+		{
+			int c = read();
+			if (c < 0)
+				continue;
+			index = (c == target[index]) ? index + 1 : (c == target[0] ? 1 : 0);
+			if (target[index] == '\0')
+				return (true);
+		}
+		return (false);
+	}
+
+protected:
+	unsigned long timeout = 1000;
+};
+
+// Does nothing by itself, the emulated streams derive from it (see HostStream.h)
+class HardwareSerial : public Stream
+{
+public:
+	virtual void begin(unsigned long baud) { (void) baud; }
+	virtual void end(void) {}
+	size_t write(uint8_t c) override { (void) c; return (1); }
+	using Print::write;
+	int available(void) override { return (0); }
+	int read(void) override { return (-1); }
+	int peek(void) override { return (-1); }
+	operator bool() { return (true); }
+};
+
+extern HardwareSerial Serial;
+
+#endif
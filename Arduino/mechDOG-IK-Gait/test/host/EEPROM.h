@@ -0,0 +1,31 @@
+/*
+ *	Description:	Host stand-in for the Arduino EEPROM library (erased: all bytes 0xFF).
+ */
+
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+
+#include "Arduino.h"
+
+#define HOST_EEPROMSize	1024
+
+class EEPROMClass
+{
+public:
+	EEPROMClass() { memset(this->data, 0xFF, sizeof(this->data)); }
+	uint8_t read(int address) { return (this->data[address]); }
+	void write(int address, uint8_t value) { this->data[address] = value; }
+	void update(int address, uint8_t value) { this->data[address] = value; }
+	uint16_t length(void) { return (HOST_EEPROMSize); }
+	bool begin(size_t size) { this->begun = size; return (size <= HOST_EEPROMSize); }	// ESP32 (flash emulated)
+	bool commit(void) { return (true); }
+	template<class T> T & get(int address, T & value) { memcpy(&value, this->data + address, sizeof(T)); return (value); }
+	template<class T> const T & put(int address, const T & value) { memcpy(this->data + address, &value, sizeof(T)); return (value); }
+
+	uint8_t data[HOST_EEPROMSize];
+	size_t begun = 0;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
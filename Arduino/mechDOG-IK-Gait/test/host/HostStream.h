@@ -0,0 +1,118 @@
+/*
+ *	Description:	Emulated serial links for the host tests.
+ *
+ *					HostStream:	bytes written by the library are kept in tx, bytes
+ *								queued with send() are read back by the library.
+ *					HostServos:	LSS servos on a bus. Every command line is logged,
+ *								the servos it owns answer the queries (Q...) from
+ *								their registers, the writes update the registers.
+ *								Config writes (C...) and queries of type 1 (ex: QAS1)
+ *								use the config registers, RESET loads them.
+ */
+
+#ifndef HOST_STREAM_H
+#define HOST_STREAM_H
+
+#include "Arduino.h"
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#define HOST_TxBuffer	63		// free bytes reported by availableForWrite (AVR UART)
+
+class HostStream : public HardwareSerial
+{
+public:
+	size_t write(uint8_t c) override
+	{
+		this->tx.push_back((char) c);
+		return (1);
+	}
+	using Print::write;
+	int availableForWrite(void) override { return (HOST_TxBuffer); }
+	int available(void) override { return ((int) (this->rx.size() - this->rxIndex)); }
+	int read(void) override { return (this->rxIndex < this->rx.size() ? (uint8_t) this->rx[this->rxIndex++] : -1); }
+	int peek(void) override { return (this->rxIndex < this->rx.size() ? (uint8_t) this->rx[this->rxIndex] : -1); }
+
+	void send(const std::string & bytes) { this->rx += bytes; }
+
+	std::string tx;
+	std::string rx;
+	size_t rxIndex = 0;
+};
+
+class HostServos : public HostStream
+{
+public:
+	explicit HostServos(std::initializer_list<uint8_t> ids) : ids(ids) {}
+
+	size_t write(uint8_t c) override
+	{
+		HostStream::write(c);
+		if (c != '\r')
+		{
+			this->line.push_back((char) c);
+			return (1);
+		}
+		this->command(this->line);
+		this->line.clear();
+		return (1);
+	}
+	using Print::write;
+
+	// IDs of the command lines received (broadcasts included)
+	std::vector<int> ids_written;
+	std::vector<std::string> lines;
+	std::set<uint8_t> ids;
+	std::map<uint8_t, std::map<std::string, int>> registers;		// session
+	std::map<uint8_t, std::map<std::string, int>> config;
+
+private:
+	void command(const std::string & l)
+	{
+		if (l.empty() || l[0] != '#')
+			return;
+		size_t i = 1;
+		int id = 0;
+		while (i < l.size() && isdigit((unsigned char) l[i]))
+			id = id * 10 + (l[i++] - '0');
+		size_t j = i;
+		while (j < l.size() && isalpha((unsigned char) l[j]))
+			j++;
+		std::string cmd = l.substr(i, j - i);
+		std::string value = l.substr(j);
+		this->lines.push_back(l);
+		this->ids_written.push_back(id);
+		if (cmd.empty())
+			return;
+		if (cmd[0] == 'Q')
+		{
+			if (this->ids.count(id) == 0)
+				return;		// not on this bus (or broadcast): no answer
+			auto & plane = (value == "1") ? this->config : this->registers;
+			int v = (cmd == "Q") ? 6 : plane[id][cmd.substr(1)];	// Q: holding
+			this->send("*" + std::to_string(id) + cmd + std::to_string(v) + "\r");
+			return;
+		}
+		bool config_write = (cmd[0] == 'C' && cmd != "CB");
+		std::string reg = config_write ? cmd.substr(1) : cmd;
+		int v = atoi(value.c_str());
+		for (uint8_t servo : this->ids)
+		{
+			if (id != 254 && id != servo)
+				continue;
+			if (cmd == "RESET")
+			{
+				for (auto & r : this->config[servo])
+					this->registers[servo][r.first] = r.second;
+			}
+			else
+				(config_write ? this->config : this->registers)[servo][reg] = v;
+		}
+	}
+
+	std::string line;
+};
+
+#endif
@@ -0,0 +1,32 @@
+/*
+ *	Description:	Minimal checks for the host tests: CHECK() reports the failures,
+ *					hostTestResult() is the exit code of the test (0: passed).
+ */
+
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdio.h>
+
+static int host_checks = 0, host_failures = 0;
+
+#define CHECK(condition)	hostCheck((condition), #condition, __FILE__, __LINE__)
+
+static inline bool hostCheck(bool passed, const char * text, const char * file, int line)
+{
+	host_checks++;
+	if (!passed)
+	{
+		host_failures++;
+		printf("%s:%d: check failed: %s\n", file, line, text);
+	}
+	return (passed);
+}
+
+static inline int hostTestResult(const char * name)
+{
+	printf("%s: %d checks, %d failed\n", name, host_checks, host_failures);
+	return (host_failures == 0 ? 0 : 1);
+}
+
+#endif
@@ -0,0 +1,17 @@
+/*
+ *	Description:	Host stand-in for the SoftwareSerial library.
+ */
+
+#ifndef HOST_SOFTWARESERIAL_H
+#define HOST_SOFTWARESERIAL_H
+
+#include "Arduino.h"
+
+class SoftwareSerial : public HardwareSerial
+{
+public:
+	SoftwareSerial(int rx, int tx) { (void) rx; (void) tx; }
+	bool listen(void) { return (true); }
+};
+
+#endif
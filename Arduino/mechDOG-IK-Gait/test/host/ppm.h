@@ -0,0 +1,17 @@
+/*
+ *	Description:	Host stand-in for the PPM reader (every channel centered).
+ */
+
+#ifndef HOST_PPM_H
+#define HOST_PPM_H
+
+class PPM
+{
+public:
+	void begin(int pin, bool invert) { (void) pin; (void) invert; }
+	int read_channel(int channel) { (void) channel; return (1500); }
+};
+
+extern PPM ppm;
+
+#endif
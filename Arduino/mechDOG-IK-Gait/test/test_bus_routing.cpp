@@ -0,0 +1,77 @@
+/*
+ *	Description:	Servo legs split across two buses (see Quadruped::initServoBus):
+ *					legs 1 & 3 on the rear bus, legs 2 & 4 on the front bus,
+ *					broadcasts on both, replies read from the bus of the servo.
+ */
+
+#include "HostStream.h"
+#include "HostTest.h"
+#include "../src/Quadruped.h"
+
+static bool onlyIDs(const HostServos & bus, std::initializer_list<int> legs)
+{
+	for (int id : bus.ids_written)
+	{
+		bool allowed = (id == LSS_BroadcastID);
+		for (int leg : legs)
+			allowed = allowed || (id / 10 == leg);
+		if (!allowed)
+			return (false);
+	}
+	return (true);
+}
+
+static bool moved(const HostServos & bus, int id)
+{
+	std::string move = "#" + std::to_string(id) + "D";
+	for (const std::string & l : bus.lines)
+	{
+		if (l.compare(0, move.size(), move) == 0)
+			return (true);
+	}
+	return (false);
+}
+
+int main(void)
+{
+	HostServos front({21, 22, 23, 41, 42, 43});
+	HostServos rear({11, 12, 13, 31, 32, 33});
+	Quadruped robot(MechDog);
+	robot.initServoBus(front, rear, LSS_DefaultBaud);
+	unsigned long start = millis();
+	while (millis() - start < 2000)
+		robot.loop();
+
+	// Gait frames
+	CHECK(onlyIDs(front, {2, 4}));
+	CHECK(onlyIDs(rear, {1, 3}));
+	for (int leg = 1; leg <= 4; leg++)
+	{
+		for (int joint = 1; joint <= 3; joint++)
+		{
+			int id = leg * 10 + joint;
+			CHECK(moved((leg % 2 == 0) ? front : rear, id));
+			CHECK(!moved((leg % 2 == 0) ? rear : front, id));
+		}
+	}
+
+	// Direct use of the library buses
+	size_t front_lines = front.lines.size(), rear_lines = rear.lines.size();
+	LSS(11).move(100);
+	LSS(42).move(-50);
+	CHECK(rear.lines.size() == rear_lines + 1 && rear.lines.back() == "#11D100");
+	CHECK(front.lines.size() == front_lines + 1 && front.lines.back() == "#42D-50");
+	LSS(LSS_BroadcastID).setColorLED(LSS_LED_Green);
+	CHECK(front.lines.back() == "#254LED2" && rear.lines.back() == "#254LED2");
+	CHECK(&LSS::getBusForID(33) == &LSS::getBus(0));
+	CHECK(&LSS::getBusForID(23) == &LSS::getBus(1));
+
+	// Replies come from the bus of the servo
+	front.registers[22]["V"] = 11900;
+	rear.registers[12]["V"] = 11100;
+	CHECK(LSS(22).getVoltage() == 11900);
+	CHECK(LSS(12).getVoltage() == 11100);
+	CHECK(LSS(12).getLastCommStatus() == LSS_CommStatus_ReadSuccess);
+
+	return (hostTestResult("test_bus_routing"));
+}
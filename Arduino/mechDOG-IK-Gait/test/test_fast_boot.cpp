@@ -0,0 +1,69 @@
+/*
+ *	Description:	Warm boot (see Quadruped::fastBoot): the config stored in the servos is read
+ *					back and only rewritten when it differs, the session values are always set.
+ *					A reset of the MCU alone leaves the servos with other session values
+ *					(speed filter, derating): their flash must not be rewritten for that.
+ */
+
+#include "HostStream.h"
+#include "HostTest.h"
+#include "../src/Quadruped.h"
+
+// Config writes (C...) sent since line from, to any ID but except
+static size_t configWrites(const HostServos & bus, size_t from, int except = -1)
+{
+	size_t count = 0;
+	for (size_t i = from; i < bus.lines.size(); i++)
+	{
+		const std::string & l = bus.lines[i];
+		size_t c = l.find_first_not_of("#0123456789");
+		if (c != std::string::npos && l[c] == 'C' && bus.ids_written[i] != except)
+			count++;
+	}
+	return (count);
+}
+
+int main(void)
+{
+	HostServos bus({11, 12, 13, 21, 22, 23, 31, 32, 33, 41, 42, 43});
+
+	// First boot: every servo gets the config
+	{
+		Quadruped robot(MechDog);
+		robot.initServoBus(bus, LSS_DefaultBaud);
+		CHECK(robot.getReconfiguredServos() == 12);
+		CHECK(configWrites(bus, 0) > 0);
+		CHECK(bus.config[11]["AS"] == ServoStiffness);
+		CHECK(bus.config[12]["G"] == -1);
+	}
+
+	// MCU reset: the servos kept the session values of the last run
+	for (uint8_t id : bus.ids)
+	{
+		bus.registers[id]["AS"] = ServoStiffness - 2;
+		bus.registers[id]["FPC"] = 9;
+	}
+	size_t lines = bus.lines.size();
+	{
+		Quadruped robot(MechDog);
+		robot.initServoBus(bus, LSS_DefaultBaud);
+		CHECK(robot.getReconfiguredServos() == 0);
+		CHECK(configWrites(bus, lines) == 0);
+		CHECK(bus.registers[11]["AS"] == ServoStiffness);
+		CHECK(bus.registers[43]["FPC"] != 9);
+	}
+
+	// A servo whose stored config differs is the only one rewritten
+	bus.config[32]["AH"] = ServoHoldingStiffness + 3;
+	lines = bus.lines.size();
+	{
+		Quadruped robot(MechDog);
+		robot.initServoBus(bus, LSS_DefaultBaud);
+		CHECK(robot.getReconfiguredServos() == 1);
+		CHECK(bus.config[32]["AH"] == ServoHoldingStiffness);
+		CHECK(configWrites(bus, lines) > 0);
+		CHECK(configWrites(bus, lines, 32) == 0);
+	}
+
+	return (hostTestResult("test_fast_boot"));
+}
@@ -0,0 +1,71 @@
+/*
+ *	Description:	Deadman of the WiFi link (see Quadruped::setLinkTimeout): once the commands
+ *					stop for the link timeout the robot stops walking and settles to the stance,
+ *					without ever holding the loop, then takes the next command as usual.
+ */
+
+#include "HostStream.h"
+#include "HostTest.h"
+#include "../src/Quadruped.h"
+
+#define TEST_LinkTimeout	500		// ms
+
+static unsigned long loop_max = 0;	// ms, longest loop() call
+
+static void run(Quadruped & robot, unsigned long ms)
+{
+	unsigned long start = millis();
+	while (millis() - start < ms)
+	{
+		unsigned long t = millis();
+		robot.loop();
+		if (millis() - t > loop_max)
+			loop_max = millis() - t;
+	}
+}
+
+int main(void)
+{
+	HostServos bus({11, 12, 13, 21, 22, 23, 31, 32, 33, 41, 42, 43});
+	HostStream link;
+	Quadruped robot(MechDog);
+	robot.initServoBus(bus, LSS_DefaultBaud);
+	robot.initMCUBus(WifiRC, link, 38400);
+	robot.setLinkTimeout(TEST_LinkTimeout);
+
+	// Walking, the host sends a command every 200 ms
+	link.send("#100M2V10\r#100M6V110\r#100M0V90S2\r");
+	for (int i = 0; i < 10; i++)
+	{
+		link.send("#100M0V90\r");
+		run(robot, 200);
+		CHECK(!robot.isLinkLost());
+	}
+
+	// Silence: lost after the timeout, within a tick
+	unsigned long silent = millis();
+	while (!robot.isLinkLost() && millis() - silent < 2 * TEST_LinkTimeout)
+		run(robot, 1);
+	CHECK(robot.isLinkLost());
+	CHECK(millis() - silent >= TEST_LinkTimeout - 200);		// last command still in its tick
+	CHECK(millis() - silent <= TEST_LinkTimeout + 200);
+
+	// Stops and settles: the servos are left alone within a few seconds
+	bool settled = false;
+	for (int i = 0; i < 20 && !settled; i++)
+	{
+		size_t lines = bus.lines.size();
+		run(robot, 500);
+		settled = (bus.lines.size() == lines);
+	}
+	CHECK(settled);
+	CHECK(robot.isLinkLost());
+	CHECK(loop_max <= 5);		// the loop is never held
+
+	// Back on the next command
+	link.send("#100M1V1\r");
+	run(robot, 200);
+	CHECK(!robot.isLinkLost());
+
+	return (hostTestResult("test_link_deadman"));
+}
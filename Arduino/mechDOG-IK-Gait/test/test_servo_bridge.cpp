@@ -0,0 +1,76 @@
+/*
+ *	Description:	Servo bridge on the MCU link (see MCU::setBridge): servo commands from the
+ *					controller are forwarded between gait frames and the replies relayed as
+ *					the servo sent them; queries of another type than the session value (ex:
+ *					QAS1) are answered without it (*5QAS-2). Writes clear the shadow
+ *					cache of the servo, baud changes (CB) are refused.
+ */
+
+#include "HostStream.h"
+#include "HostTest.h"
+#include "../src/LSS_MCU.h"
+
+// Parse a command from the link, forward it and wait for the reply (or its timeout)
+static std::string bridge(HostStream & link, const char * command)
+{
+	link.tx.clear();
+	link.send(command);
+	MCU_Command received;
+	MCU::genericRead(received);
+	MCU::serviceBridge();
+	unsigned long start = millis();
+	while (millis() - start < 2 * LSS_Timeout)
+		LSS::pollBuses();
+	return (link.tx);
+}
+
+int main(void)
+{
+	HostStream link;
+	HostServos servos({5});
+	LSS::initBus(servos, LSS_DefaultBaud);
+	MCU::initBus(link, 38400);
+	MCU::setBridge(true);
+	servos.registers[5]["AS"] = 0;
+	servos.registers[5]["D"] = -450;
+	servos.config[5]["AS"] = -2;
+	servos.config[5]["FPC"] = 10;
+	servos.config[5]["G"] = -1;
+	servos.config[5]["O"] = -35;
+
+	// Session and config queries
+	CHECK(bridge(link, "#5QD\r") == "*5QD-450\r");
+	CHECK(bridge(link, "#5QAS\r") == "*5QAS0\r");
+	CHECK(bridge(link, "#5QAS1\r") == "*5QAS-2\r");
+	CHECK(servos.lines.back() == "#5QAS1");
+	CHECK(bridge(link, "#5QFPC1\r") == "*5QFPC10\r");
+	CHECK(bridge(link, "#5QG1\r") == "*5QG-1\r");
+	CHECK(bridge(link, "#5QO1\r") == "*5QO-35\r");
+	LSS_BusStats stats;
+	if (LSS::getStats(5, stats))
+		CHECK(stats.wrongIdentifier == 0);
+
+	// No answer: explicit error, not an unknown query type
+	CHECK(bridge(link, "#6QV\r") == "*6QVERR2\r");
+	size_t lines = servos.lines.size();
+	CHECK(bridge(link, "#5QAS9\r").empty());
+	CHECK(servos.lines.size() == lines);
+
+	// Writes: the cached getters ask the servo again
+	servos.registers[5]["AS"] = 1;
+	CHECK(LSS(5).getAngularStiffness() == 1);
+	bridge(link, "#5AS2\r");
+	CHECK(servos.lines.back() == "#5AS2");
+	CHECK(LSS(5).getAngularStiffness() == 2);
+	CHECK(LSS(5).getFilterPositionCount(LSS_QueryConfig) == 10);
+	bridge(link, "#254CFPC4\r");
+	CHECK(LSS(5).getFilterPositionCount(LSS_QueryConfig) == 4);
+
+	// Baud changes are refused
+	lines = servos.lines.size();
+	bridge(link, "#5CB115200\r");
+	bridge(link, "#254CB115200\r");
+	CHECK(servos.lines.size() == lines);
+
+	return (hostTestResult("test_servo_bridge"));
+}
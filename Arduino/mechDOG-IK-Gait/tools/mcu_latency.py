@@ -0,0 +1,142 @@
+#!/usr/bin/env python3
+"""
+Command latency of the mechDOG IK-Gait sketch, measured over the MCU link.
+
+Sends motion commands tagged with E<tag> and collects the timing echo the robot
+returns once the first joint frame computed with each command has left on the
+servo bus:
+    *<id>ECH<tag>,<received>,<applied>,<transmitted>\r     (robot micros())
+
+and reports the distribution of
+    link      host -> robot, estimated as half of the round trip not spent in the robot
+    pickup    received -> applied: wait for the gait to pick the command up (update_traj)
+    output    applied -> transmitted: wait for the frame to be sent to the servos
+    robot     received -> transmitted
+    total     host send -> frame on the servo bus (link + robot)
+
+Binary frames on the link (telemetry) are skipped.
+
+Example:
+    python3 mcu_latency.py /dev/ttyUSB0 --register 0 --values 90 270 --count 200 --rate 2
+Requires pyserial.
+"""
+
+import argparse
+import statistics
+import sys
+import time
+
+import serial
+
+SYNC = 0xA5
+WRAP = 1 << 32
+
+
+class EchoReader:
+    """Splits the byte stream from the robot into ASCII replies, skipping binary frames."""
+
+    def __init__(self, port):
+        self.port = port
+        self.buffer = bytearray()
+
+    def replies(self):
+        self.buffer += self.port.read(self.port.in_waiting or 1)
+        out = []
+        while self.buffer:
+            if self.buffer[0] == SYNC:
+                if len(self.buffer) < 2:
+                    break
+                size = self.buffer[1] + 4       # sync, length, payload, CRC
+                if len(self.buffer) < size:
+                    break
+                del self.buffer[:size]
+            elif self.buffer[0] == ord('*'):
+                end = self.buffer.find(b'\r')
+                if end < 0:
+                    break
+                out.append(self.buffer[1:end].decode('ascii', 'replace'))
+                del self.buffer[:end + 1]
+            else:
+                del self.buffer[0]
+        return out
+
+
+def parse_echo(reply, mcu_id):
+    head = '%dECH' % mcu_id
+    if not reply.startswith(head):
+        return None
+    try:
+        tag, received, applied, transmitted = (int(v) for v in reply[len(head):].split(','))
+    except ValueError:
+        return None
+    return tag, received, applied, transmitted
+
+
+def summary(name, samples):
+    if not samples:
+        print('%-8s no samples' % name)
+        return
+    s = sorted(samples)
+    pick = lambda q: s[min(len(s) - 1, int(q * len(s)))]
+    print('%-8s n=%-4d min %7.1f  p50 %7.1f  p90 %7.1f  p99 %7.1f  max %7.1f  mean %7.1f ms' % (
+        name, len(s), s[0], pick(0.5), pick(0.9), pick(0.99), s[-1], statistics.mean(s)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+    parser.add_argument('port')
+    parser.add_argument('--baud', type=int, default=38400)
+    parser.add_argument('--id', type=int, default=100, help='MCU ID')
+    parser.add_argument('--register', type=int, default=0, help='motion register (0: walk)')
+    parser.add_argument('--values', type=int, nargs='+', default=[90, 270], help='values sent in turn')
+    parser.add_argument('--count', type=int, default=100)
+    parser.add_argument('--rate', type=float, default=2.0, help='commands per second')
+    parser.add_argument('--timeout', type=float, default=3.0, help='s to wait for an echo')
+    args = parser.parse_args()
+
+    port = serial.Serial(args.port, args.baud, timeout=0.01)
+    reader = EchoReader(port)
+    results = {name: [] for name in ('link', 'pickup', 'output', 'robot', 'total')}
+    lost = 0
+
+    for n in range(args.count):
+        tag = n % 32768
+        value = args.values[n % len(args.values)]
+        sent = time.perf_counter()
+        port.write(b'#%dM%dV%dE%d\r' % (args.id, args.register, value, tag))
+        echo = None
+        while echo is None and time.perf_counter() - sent < args.timeout:
+            for reply in reader.replies():
+                fields = parse_echo(reply, args.id)
+                if fields and fields[0] == tag:
+                    echo = fields
+        answered = time.perf_counter()
+        if echo is None:
+            lost += 1
+            continue
+
+        _, received, applied, transmitted = echo
+        pickup = ((applied - received) % WRAP) / 1000.0
+        results['pickup'].append(pickup)
+        if transmitted:
+            output = ((transmitted - applied) % WRAP) / 1000.0
+            robot = ((transmitted - received) % WRAP) / 1000.0
+            results['output'].append(output)
+        else:
+            robot = pickup                  # the command did not produce a frame
+        results['robot'].append(robot)
+        link = max(0.0, ((answered - sent) * 1000.0 - robot) / 2)
+        results['link'].append(link)
+        results['total'].append(link + robot)
+
+        time.sleep(max(0.0, 1.0 / args.rate - (time.perf_counter() - sent)))
+
+    for name, samples in results.items():
+        summary(name, samples)
+    if lost:
+        print('%d of %d commands without echo' % (lost, args.count))
+    return 0 if lost < args.count else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
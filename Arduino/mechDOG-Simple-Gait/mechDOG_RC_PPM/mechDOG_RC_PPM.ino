@@ -85,11 +85,14 @@ byte state;
 byte prevState;
 byte phase = 1;
 byte phaseDelay = 50;
-byte queryDelay = 2;
 
 bool wakeUpDone = false; // to indicate if wakeUp() has reached its target positions
 bool moving = false;     // indicates if it is running a motion function
 
+unsigned int queryGuard = 3000; // us to wait for one position reply before the next query goes out
+
+const byte servoIDs[12] = {11, 12, 13, 21, 22, 23, 31, 32, 33, 41, 42, 43};
+
 void setup()
 { 
   // Buffer between USB & ATmega for LSS-2IO
@@ -208,18 +211,89 @@ void loop()
 
 void queryPos() // query positions and set them as current positions
 {
-  currPos11 = myLSS11.getPosition() + offset11; delay(queryDelay);
-  currPos12 = myLSS12.getPosition() + offset12; delay(queryDelay);
-  currPos13 = myLSS13.getPosition() + offset13; delay(queryDelay);
-  currPos21 = myLSS21.getPosition() + offset21; delay(queryDelay);
-  currPos22 = myLSS22.getPosition() + offset22; delay(queryDelay);
-  currPos23 = myLSS23.getPosition() + offset23; delay(queryDelay);
-  currPos31 = myLSS31.getPosition() + offset31; delay(queryDelay);
-  currPos32 = myLSS32.getPosition() + offset32; delay(queryDelay);
-  currPos33 = myLSS33.getPosition() + offset33; delay(queryDelay);
-  currPos41 = myLSS41.getPosition() + offset41; delay(queryDelay);
-  currPos42 = myLSS42.getPosition() + offset42; delay(queryDelay);
-  currPos43 = myLSS43.getPosition() + offset43; delay(queryDelay);
+  int pos[12];
+  capturePos(pos);
+
+  currPos11 = pos[0] + offset11;
+  currPos12 = pos[1] + offset12;
+  currPos13 = pos[2] + offset13;
+  currPos21 = pos[3] + offset21;
+  currPos22 = pos[4] + offset22;
+  currPos23 = pos[5] + offset23;
+  currPos31 = pos[6] + offset31;
+  currPos32 = pos[7] + offset32;
+  currPos33 = pos[8] + offset33;
+  currPos41 = pos[9] + offset41;
+  currPos42 = pos[10] + offset42;
+  currPos43 = pos[11] + offset43;
+}
+
+byte capturePos(int pos[]) // query all servos back to back and collect the replies as they arrive
+{
+  byte count = 0;
+  unsigned long t;
+
+  while (Serial.available()) Serial.read(); // discard anything left from the reset
+  parseReply(pos, true);
+
+  for (byte n = 0; n < 12; n++)
+  {
+    pos[n] = 0; // like getPosition(), a servo that does not answer reads as 0
+    LSS::genericWrite(servoIDs[n], LSS_QueryPosition);
+
+    // next query goes out as soon as this reply is in (bus is free again), or after the guard
+    t = micros();
+    while (micros() - t < queryGuard)
+    {
+      byte id = parseReply(pos, false);
+      if (id) count++;
+      if (id == servoIDs[n]) break;
+    }
+  }
+  return count;
+}
+
+byte parseReply(int pos[], bool reset) // feed received bytes to a "*<id>QD<value>\r" parser, returns the ID of a completed reply (0 if none)
+{
+  static byte stage; // 0 = wait for '*', 1 = ID, 2 = 'D', 3 = value
+  static byte id;
+  static long value;
+  static bool negative;
+
+  if (reset) { stage = 0; return 0; }
+
+  while (Serial.available())
+  {
+    char c = Serial.read();
+    if (c == '*') { stage = 1; id = 0; value = 0; negative = false; continue; }
+
+    switch (stage)
+    {
+      case 1:
+        if (c >= '0' && c <= '9') id = id * 10 + (c - '0');
+        else stage = (c == 'Q') ? 2 : 0;
+        break;
+      case 2:
+        stage = (c == 'D') ? 3 : 0;
+        break;
+      case 3:
+        if (c == '-' && value == 0 && !negative) negative = true;
+        else if (c >= '0' && c <= '9') value = value * 10 + (c - '0');
+        else
+        {
+          stage = 0;
+          if (c != '\r') break;
+          for (byte n = 0; n < 12; n++)
+          {
+            if (servoIDs[n] != id) continue;
+            pos[n] = negative ? -value : value;
+            return id;
+          }
+        }
+        break;
+    }
+  }
+  return 0;
 }
 
 void wakeUp()